@@ -0,0 +1,108 @@
+// Cost of the ordered key index (--key-index) on the write path: inserting and deleting new
+// keys in the hash table alone, as the server does without the index, against the hash table
+// plus the AVL tree. Also times KEYPREFIX-style scans. Runs in-process, without the network.
+//
+//   cacheX_bench_key_index [keys]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "avl.hpp"
+#include "common.hpp"
+#include "hashmap.hpp"
+
+struct Item {
+    HNode node;
+    AVLNode tnode;
+    std::string key;
+};
+
+static uint64_t now_ns() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool item_eq(HNode *a, HNode *b) {
+    return container_of(a, Item, node)->key == container_of(b, Item, node)->key;
+}
+
+static bool item_less(AVLNode *a, AVLNode *b) {
+    return container_of(a, Item, tnode)->key < container_of(b, Item, tnode)->key;
+}
+
+static bool item_below(AVLNode *node, const void *key) {
+    return container_of(node, Item, tnode)->key < *static_cast<const std::string *>(key);
+}
+
+// Insert then delete every item in the given order; returns ns per insert and per delete
+static void run(std::vector<Item> &items, bool indexed, double &insert_ns, double &delete_ns) {
+    HMap db;
+    AVLNode *root = nullptr;
+    uint64_t start = now_ns();
+    for (Item &item : items) {
+        db.insert(&item.node);
+        if (indexed) {
+            avl_insert(&root, &item.tnode, &item_less);
+        }
+    }
+    uint64_t mid = now_ns();
+    for (Item &item : items) {
+        db.hm_delete(&item.node, &item_eq);
+        if (indexed) {
+            avl_remove(&root, &item.tnode);
+        }
+    }
+    uint64_t end = now_ns();
+    db.clear();
+    insert_ns = (double)(mid - start) / items.size();
+    delete_ns = (double)(end - mid) / items.size();
+}
+
+int main(int argc, char **argv) {
+    size_t nkeys = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    std::vector<Item> items(nkeys);
+    for (size_t i = 0; i < nkeys; i++) {
+        items[i].key = "user:" + std::to_string(i / 8) + ":session:" + std::to_string(i % 8);
+        items[i].node.hcode = str_hash((const uint8_t *)items[i].key.data(), items[i].key.size());
+    }
+    std::shuffle(items.begin(), items.end(), std::mt19937(42));
+
+    double plain_insert, plain_delete, index_insert, index_delete;
+    run(items, false, plain_insert, plain_delete);
+    run(items, true, index_insert, index_delete);
+    printf("keys=%zu\n", nkeys);
+    printf("hash only:    insert=%.0fns delete=%.0fns\n", plain_insert, plain_delete);
+    printf("hash + index: insert=%.0fns (+%.0fns) delete=%.0fns (+%.0fns)\n", index_insert,
+           index_insert - plain_insert, index_delete, index_delete - plain_delete);
+
+    // Prefix scans of one user's 8 sessions, over the full tree
+    AVLNode *root = nullptr;
+    for (Item &item : items) {
+        avl_insert(&root, &item.tnode, &item_less);
+    }
+    const int scans = 100000;
+    size_t found = 0;
+    std::mt19937 rng(7);
+    uint64_t start = now_ns();
+    for (int i = 0; i < scans; i++) {
+        std::string prefix = "user:" + std::to_string(rng() % (nkeys / 8 + 1)) + ":";
+        AVLNode *node = avl_lower_bound(root, &item_below, &prefix);
+        for (; node; node = avl_next(node)) {
+            const std::string &key = container_of(node, Item, tnode)->key;
+            if (key.compare(0, prefix.size(), prefix) != 0) {
+                break;
+            }
+            found++;
+        }
+    }
+    printf("prefix scan:  %.0fns per scan, %.1f keys each\n",
+           (double)(now_ns() - start) / scans, (double)found / scans);
+    return 0;
+}
@@ -0,0 +1,73 @@
+// Round-trip latency of sequential GETs over TCP loopback and the Unix domain socket.
+//
+//   cacheX -s /tmp/cacheX.sock 2>/dev/null &
+//   cacheX_bench_rtt [host] [port] [unix path] [requests]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+
+static uint64_t now_ns() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench(const char *label, int sock, int requests) {
+    if (sock < 0) {
+        fprintf(stderr, "[ERROR] %s: connect failed.\n", label);
+        return -1;
+    }
+
+    Response resp;
+    std::vector<std::string> set = {"SET", "bench:rtt", std::string(64, 'x')};
+    std::vector<std::string> get = {"GET", "bench:rtt"};
+    if (send_request(sock, set) < 0 || read_response(sock, resp) < 0) {
+        return -1;
+    }
+
+    // Warm up caches and the connection before sampling
+    for (int i = 0; i < 1000; i++) {
+        if (send_request(sock, get) < 0 || read_response(sock, resp) < 0) {
+            return -1;
+        }
+    }
+
+    std::vector<uint64_t> samples(requests);
+    for (int i = 0; i < requests; i++) {
+        uint64_t start = now_ns();
+        if (send_request(sock, get) < 0 || read_response(sock, resp) < 0) {
+            return -1;
+        }
+        samples[i] = now_ns() - start;
+    }
+    cacheX_close(sock);
+
+    std::sort(samples.begin(), samples.end());
+    uint64_t total = 0;
+    for (uint64_t s : samples) {
+        total += s;
+    }
+    printf("%-6s requests=%d mean=%.2fus p50=%.2fus p99=%.2fus p999=%.2fus\n", label, requests,
+           total / 1000.0 / requests, samples[requests / 2] / 1000.0,
+           samples[requests * 99 / 100] / 1000.0, samples[requests * 999 / 1000] / 1000.0);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 6379;
+    const char *path = argc > 3 ? argv[3] : "/tmp/cacheX.sock";
+    int requests = argc > 4 ? atoi(argv[4]) : 100000;
+
+    int rv = bench("tcp", cacheX_connect(host, port), requests);
+    rv |= bench("unix", cacheX_connect_unix(path), requests);
+    return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
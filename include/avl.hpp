@@ -0,0 +1,182 @@
+#ifndef AVL_HPP_
+#define AVL_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Intrusive AVL tree. Items embed an AVLNode and are recovered with container_of(); the tree
+// is just a pointer to its root. Parent links make in-order iteration (avl_next) possible
+// without a stack, so a range scan costs O(log n + k).
+struct AVLNode {
+    AVLNode *parent = nullptr;
+    AVLNode *left = nullptr;
+    AVLNode *right = nullptr;
+    uint32_t height = 0;  // 0 while the node is not in a tree
+};
+
+inline uint32_t avl_height(AVLNode *node) { return node ? node->height : 0; }
+
+inline bool avl_linked(const AVLNode *node) { return node->height != 0; }
+
+inline void avl_update(AVLNode *node) {
+    uint32_t l = avl_height(node->left), r = avl_height(node->right);
+    node->height = 1 + (l > r ? l : r);
+}
+
+// The right child takes node's place; its left subtree (inner) becomes node's right subtree
+inline AVLNode *avl_rot_left(AVLNode *node) {
+    AVLNode *parent = node->parent;
+    AVLNode *new_node = node->right;
+    AVLNode *inner = new_node->left;
+    node->right = inner;
+    if (inner) {
+        inner->parent = node;
+    }
+    new_node->parent = parent;
+    new_node->left = node;
+    node->parent = new_node;
+    avl_update(node);
+    avl_update(new_node);
+    return new_node;
+}
+
+inline AVLNode *avl_rot_right(AVLNode *node) {
+    AVLNode *parent = node->parent;
+    AVLNode *new_node = node->left;
+    AVLNode *inner = new_node->right;
+    node->left = inner;
+    if (inner) {
+        inner->parent = node;
+    }
+    new_node->parent = parent;
+    new_node->right = node;
+    node->parent = new_node;
+    avl_update(node);
+    avl_update(new_node);
+    return new_node;
+}
+
+// The left subtree is 2 levels taller: one rotation, or two if it leans inwards
+inline AVLNode *avl_fix_left(AVLNode *node) {
+    if (avl_height(node->left->left) < avl_height(node->left->right)) {
+        node->left = avl_rot_left(node->left);
+    }
+    return avl_rot_right(node);
+}
+
+inline AVLNode *avl_fix_right(AVLNode *node) {
+    if (avl_height(node->right->right) < avl_height(node->right->left)) {
+        node->right = avl_rot_right(node->right);
+    }
+    return avl_rot_left(node);
+}
+
+// Restore heights and balance from node up to the root after an insert or delete below it.
+// Returns the root.
+inline AVLNode *avl_fix(AVLNode *node) {
+    while (true) {
+        AVLNode **from = &node;
+        AVLNode *parent = node->parent;
+        if (parent) {
+            from = parent->left == node ? &parent->left : &parent->right;
+        }
+        avl_update(node);
+        uint32_t l = avl_height(node->left), r = avl_height(node->right);
+        if (l == r + 2) {
+            *from = avl_fix_left(node);
+        } else if (l + 2 == r) {
+            *from = avl_fix_right(node);
+        }
+        if (!parent) {
+            return *from;
+        }
+        node = parent;
+    }
+}
+
+// Unlink a node that has at most one child. Returns the new root.
+inline AVLNode *avl_del_easy(AVLNode *node) {
+    AVLNode *child = node->left ? node->left : node->right;
+    AVLNode *parent = node->parent;
+    if (child) {
+        child->parent = parent;
+    }
+    if (!parent) {
+        return child;
+    }
+    AVLNode **from = parent->left == node ? &parent->left : &parent->right;
+    *from = child;
+    return avl_fix(parent);
+}
+
+// Link node into the tree at *root. less() orders two nodes; equal ones go to the right.
+inline void avl_insert(AVLNode **root, AVLNode *node, bool (*less)(AVLNode *, AVLNode *)) {
+    node->left = node->right = nullptr;
+    node->height = 1;
+    AVLNode *parent = nullptr;
+    AVLNode **from = root;
+    while (*from) {
+        parent = *from;
+        from = less(node, parent) ? &parent->left : &parent->right;
+    }
+    *from = node;
+    node->parent = parent;
+    *root = avl_fix(node);
+}
+
+inline void avl_remove(AVLNode **root, AVLNode *node) {
+    if (!node->left || !node->right) {
+        *root = avl_del_easy(node);
+    } else {
+        // Two children: the successor takes the node's place
+        AVLNode *victim = node->right;
+        while (victim->left) {
+            victim = victim->left;
+        }
+        AVLNode *new_root = avl_del_easy(victim);
+        *victim = *node;
+        if (victim->left) {
+            victim->left->parent = victim;
+        }
+        if (victim->right) {
+            victim->right->parent = victim;
+        }
+        AVLNode **from = &new_root;
+        if (AVLNode *parent = node->parent) {
+            from = parent->left == node ? &parent->left : &parent->right;
+        }
+        *from = victim;
+        *root = new_root;
+    }
+    *node = AVLNode{};
+}
+
+// In-order successor, or nullptr after the last node
+inline AVLNode *avl_next(AVLNode *node) {
+    if (node->right) {
+        for (node = node->right; node->left; node = node->left) {
+        }
+        return node;
+    }
+    while (node->parent && node->parent->right == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+// First node that is not below key, where below(node, key) says the node sorts before key
+inline AVLNode *avl_lower_bound(AVLNode *root, bool (*below)(AVLNode *, const void *),
+                                const void *key) {
+    AVLNode *found = nullptr;
+    while (root) {
+        if (below(root, key)) {
+            root = root->right;
+        } else {
+            found = root;
+            root = root->left;
+        }
+    }
+    return found;
+}
+
+#endif  // AVL_HPP_
@@ -0,0 +1,121 @@
+#ifndef BULK_FILE_HPP_
+#define BULK_FILE_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "cacheX_protocol.hpp"
+#include "snapshot.hpp"
+
+// Input for BULKLOAD: a snapshot stream (snapshot.hpp) followed by a chunk index, so the
+// loader can presize the table and split the records between threads without scanning first.
+// Each chunk starts on a record boundary; the last one ends at the END marker.
+//
+// +----------+---------+-----+---------+-----------------+-----+--------------+-------+
+// | snapshot | records | END | nchunks | offset | nkeys  | ... | index offset | magic |
+// +----------+---------+-----+---------+-----------------+-----+--------------+-------+
+//                                  4B       8B       8B             8B           4B
+constexpr uint8_t kBulkIndexMagic[4] = {'C', 'X', 'I', 'X'};
+constexpr size_t kBulkTrailerSize = 8 + 4;
+constexpr size_t kBulkChunkSize = 4 * 1024 * 1024;
+
+struct BulkChunk {
+    uint64_t offset = 0;  // of the first record, from the start of the file
+    uint64_t nkeys = 0;
+};
+
+// Streams a bulk file to disk; the whole dataset never has to fit in memory
+struct BulkWriter {
+    FILE *fp = nullptr;
+    size_t chunk_size = kBulkChunkSize;
+    uint64_t offset = 0;  // file offset of buf[0]
+    std::vector<uint8_t> buf;
+    std::vector<BulkChunk> chunks;
+};
+
+inline bool bulk_writer_flush(BulkWriter &w) {
+    if (!w.buf.empty() && fwrite(w.buf.data(), 1, w.buf.size(), w.fp) != w.buf.size()) {
+        return false;
+    }
+    w.offset += w.buf.size();
+    w.buf.clear();
+    return true;
+}
+
+inline bool bulk_writer_open(BulkWriter &w, const char *path) {
+    w.fp = fopen(path, "wb");
+    if (!w.fp) {
+        return false;
+    }
+    snapshot_put_header(w.buf);
+    w.chunks.push_back(BulkChunk{kSnapshotHeaderSize, 0});
+    return true;
+}
+
+inline bool bulk_writer_put(BulkWriter &w, uint8_t type, const std::string &key,
+                            const uint8_t *value, size_t vlen) {
+    BulkChunk &last = w.chunks.back();
+    if (w.offset + w.buf.size() - last.offset >= w.chunk_size) {
+        w.chunks.push_back(BulkChunk{w.offset + w.buf.size(), 0});
+    }
+    snapshot_put_record(w.buf, type, 0, key, value, vlen);
+    w.chunks.back().nkeys++;
+    return w.buf.size() < kBulkChunkSize || bulk_writer_flush(w);
+}
+
+// Write the END marker and the index, and close the file. Returns false on any write error.
+inline bool bulk_writer_close(BulkWriter &w) {
+    snapshot_put_end(w.buf);
+    uint64_t index_offset = w.offset + w.buf.size();
+    uint32_t nchunks = w.chunks.size();
+    buffer_append(w.buf, (const uint8_t *)&nchunks, 4);
+    for (const BulkChunk &chunk : w.chunks) {
+        buffer_append(w.buf, (const uint8_t *)&chunk.offset, 8);
+        buffer_append(w.buf, (const uint8_t *)&chunk.nkeys, 8);
+    }
+    buffer_append(w.buf, (const uint8_t *)&index_offset, 8);
+    buffer_append(w.buf, kBulkIndexMagic, 4);
+    bool ok = bulk_writer_flush(w);
+    return fclose(w.fp) == 0 && ok;
+}
+
+// Read and check the index of a bulk file held in memory. On success chunks describes the
+// records, and end is the offset of the END marker. Returns 0, or -1 if the file is malformed.
+inline int32_t bulk_read_index(const uint8_t *data, size_t size, std::vector<BulkChunk> &chunks,
+                               uint64_t &end) {
+    if (size < kSnapshotHeaderSize + 1 + 4 + kBulkTrailerSize ||
+        snapshot_check_header(data) != (int32_t)kSnapshotVersion ||
+        memcmp(data + size - 4, kBulkIndexMagic, 4) != 0) {
+        return -1;
+    }
+    uint64_t index_offset = 0;
+    uint32_t nchunks = 0;
+    memcpy(&index_offset, data + size - kBulkTrailerSize, 8);
+    if (index_offset < kSnapshotHeaderSize + 1 || index_offset + 4 > size - kBulkTrailerSize) {
+        return -1;
+    }
+    memcpy(&nchunks, data + index_offset, 4);
+    if (nchunks == 0 || index_offset + 4 + (uint64_t)nchunks * 16 != size - kBulkTrailerSize) {
+        return -1;
+    }
+    end = index_offset - 1;
+    if (data[end] != REC_END) {
+        return -1;
+    }
+    chunks.resize(nchunks);
+    for (uint32_t i = 0; i < nchunks; i++) {
+        memcpy(&chunks[i].offset, data + index_offset + 4 + i * 16, 8);
+        memcpy(&chunks[i].nkeys, data + index_offset + 4 + i * 16 + 8, 8);
+        uint64_t prev = i ? chunks[i - 1].offset : kSnapshotHeaderSize;
+        if (chunks[i].offset < prev || chunks[i].offset > end) {
+            return -1;
+        }
+    }
+    return chunks[0].offset == kSnapshotHeaderSize ? 0 : -1;
+}
+
+#endif  // BULK_FILE_HPP_
@@ -0,0 +1,55 @@
+#ifndef CACHEX_ASYNC_HPP_
+#define CACHEX_ASYNC_HPP_
+
+#include <stddef.h>
+
+#include <functional>
+#include <string>
+
+// Completion callback. status is a ResponseStatus (RES_OK, RES_NX, RES_ERR) or -1 if the
+// connection carrying the request failed; value holds the reply payload.
+typedef std::function<void(int status, const std::string &value)> CacheXCallback;
+
+// Opaque handle: a few non-blocking connections to one server driven by a private epoll loop
+struct CacheXAsync;
+
+// Open nconns connections to host:port (nconns <= 0 means 1). Returns nullptr if none connect.
+// Each connection switches to protocol v2 when the server supports it, which matches replies by
+// request ID and makes quiet requests possible.
+CacheXAsync *cacheX_async_connect(const char *host, int port, int nconns);
+
+// Queue a command. Nothing is sent until cacheX_async_poll() or cacheX_async_wait() runs, so
+// thousands of requests can be queued back to back and leave in a few large writes. Replies on
+// a connection arrive in request order and each fires its own callback. Returns -1 if no
+// connection is alive.
+int cacheX_async_set(CacheXAsync *client, const std::string &key, const std::string &value,
+                     CacheXCallback cb);
+int cacheX_async_get(CacheXAsync *client, const std::string &key, CacheXCallback cb);
+
+// Fire-and-forget SET: the server sends no reply unless it fails, and failures are only logged.
+// Saves the reply traffic when loading data; needs a server that speaks protocol v2. The SET
+// stays pending until the reply to a later request on its connection shows it has run.
+int cacheX_async_set_quiet(CacheXAsync *client, const std::string &key, const std::string &value);
+int cacheX_async_del(CacheXAsync *client, const std::string &key, CacheXCallback cb);
+
+// Flush queued requests and dispatch any replies that arrive within timeout_ms (-1 blocks
+// until at least one event). Returns the number of callbacks run, or -1 on error.
+int cacheX_async_poll(CacheXAsync *client, int timeout_ms);
+
+// Poll until every request has completed. Quiet requests that no later request follows get a
+// HELLO queued behind them, so the server has run them too by the time this returns.
+int cacheX_async_wait(CacheXAsync *client);
+
+// Number of requests not known to be done: those whose callback has not run, and quiet ones
+// that no reply has confirmed yet
+size_t cacheX_async_pending(CacheXAsync *client);
+
+// The epoll descriptor, readable whenever cacheX_async_poll() has work to do: replies to
+// dispatch, or queued requests to send. Lets callers nest the client inside their own event
+// loop, calling cacheX_async_poll(client, 0) each time it is readable.
+int cacheX_async_fd(CacheXAsync *client);
+
+// Close the connections. Callbacks of requests still in flight run with status -1.
+void cacheX_async_close(CacheXAsync *client);
+
+#endif  // CACHEX_ASYNC_HPP_
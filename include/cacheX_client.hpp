@@ -1,17 +1,91 @@
 #ifndef CACHEX_CLIENT_HPP_
 #define CACHEX_CLIENT_HPP_
 
+#include <stdint.h>
+
 #include <string>
+#include <utility>
+#include <vector>
 
 // Initialize the client connection
 int cacheX_connect(const char *host, int port);
 
+// Connect to a server on the same host through its Unix domain socket
+int cacheX_connect_unix(const char *path);
+
+// Switch the connection to protocol version (1 or 2, see PROTOCOL.md). Returns the version now
+// in effect, or -1 if the server refused it. The other functions here speak v1 only.
+int cacheX_hello(int sock, int version);
+
 // Send a SET command
 int cacheX_set(int sock, const std::string &key, const std::string &value);
 
 // Send a GET command
 std::string cacheX_get(int sock, const std::string &ey);
 
+// Optimistic concurrency. Every write gives a key a new 64-bit version.
+// cacheX_get_versioned: 0 and the value and version if the key exists, 1 if it does not, -1 on
+// error. cacheX_set_if: write only when the condition holds; returns the new version, 0 if the
+// condition failed, -1 on error. cacheX_getset: store value and fetch the previous one; 0 if
+// there was one, 1 if not, -1 on error.
+enum CacheXSetCond {
+    CACHEX_SET_NX,     // the key must not exist
+    CACHEX_SET_XX,     // the key must exist
+    CACHEX_SET_IFVER,  // the key must be at the given version
+};
+int cacheX_get_versioned(int sock, const std::string &key, std::string &value,
+                         uint64_t &version);
+int64_t cacheX_set_if(int sock, const std::string &key, const std::string &value,
+                      CacheXSetCond cond, uint64_t version = 0);
+int cacheX_getset(int sock, const std::string &key, const std::string &value, std::string &old);
+
+// Hashes. hset/hdel return the number of fields added/removed (-1 on error). hget returns an
+// empty string for a missing field; hmget leaves found[i] false for each missing field.
+int cacheX_hset(int sock, const std::string &key,
+                const std::vector<std::pair<std::string, std::string>> &fields);
+std::string cacheX_hget(int sock, const std::string &key, const std::string &field);
+int cacheX_hmget(int sock, const std::string &key, const std::vector<std::string> &fields,
+                 std::vector<std::string> &values, std::vector<bool> &found);
+int cacheX_hdel(int sock, const std::string &key, const std::vector<std::string> &fields);
+int cacheX_hgetall(int sock, const std::string &key,
+                   std::vector<std::pair<std::string, std::string>> &out);
+
+// HyperLogLog: add elements (returns 1 if the estimate may have changed, 0 if not, -1 on
+// error), count the union of one or more sketches (-1 on error), merge sources into dest
+int cacheX_pfadd(int sock, const std::string &key, const std::vector<std::string> &elements);
+int64_t cacheX_pfcount(int sock, const std::vector<std::string> &keys);
+int cacheX_pfmerge(int sock, const std::string &dest, const std::vector<std::string> &sources);
+
+// Fetch the hottest keys by read (or write) rate as (key, estimated ops/sec) pairs
+int cacheX_hotkeys(int sock, bool writes, int count,
+                   std::vector<std::pair<std::string, uint64_t>> &out);
+
+// Load a bulk file (see cacheX_bulk_build) that is on the server's filesystem. Returns the
+// number of records loaded, or -1 on error.
+int64_t cacheX_bulkload(int sock, const std::string &path);
+
+// Ordered key scans; the server must run with --key-index. keyrange: keys k with
+// start <= k < end (an empty end has no upper bound). keyprefix: keys starting with prefix.
+// Both return at most limit keys in byte order, 0 on success and -1 on error.
+int cacheX_keyrange(int sock, const std::string &start, const std::string &end, uint64_t limit,
+                    std::vector<std::string> &keys);
+int cacheX_keyprefix(int sock, const std::string &prefix, uint64_t limit,
+                     std::vector<std::string> &keys);
+
+// Remove keys; large values are freed in the background. Returns the number of keys removed,
+// or -1 on error.
+int64_t cacheX_unlink(int sock, const std::vector<std::string> &keys);
+
+// Remove every key. With async the server frees the memory in the background. 0 or -1.
+int cacheX_flushall(int sock, bool async);
+
+// Publish message on channel. Returns the number of subscribers it was sent to, or -1 on
+// error. Subscribing takes a dedicated connection, see cacheX_pubsub.hpp.
+int64_t cacheX_publish(int sock, const std::string &channel, const std::string &message);
+
+// Fetch server statistics as (name, value) pairs (see INFO in PROTOCOL.md)
+int cacheX_info(int sock, std::vector<std::pair<std::string, std::string>> &out);
+
 // Close the connection
 void cacheX_close(int sock);
 
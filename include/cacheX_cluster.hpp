@@ -0,0 +1,33 @@
+#ifndef CACHEX_CLUSTER_HPP_
+#define CACHEX_CLUSTER_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Opaque handle for a set of cacheX servers addressed through a consistent-hash ring.
+struct CacheXCluster;
+
+// Connect to every node in the list ("host:port" strings). Nodes that cannot be reached are
+// marked down and retried later; returns nullptr only if the list is empty or malformed.
+CacheXCluster *cacheX_cluster_connect(const std::vector<std::string> &nodes);
+
+// Single-key commands, routed to the node that owns the key
+int cacheX_cluster_set(CacheXCluster *cluster, const std::string &key, const std::string &value);
+std::string cacheX_cluster_get(CacheXCluster *cluster, const std::string &key);
+int cacheX_cluster_del(CacheXCluster *cluster, const std::string &key);
+
+// Multi-key commands. Keys are grouped by node and each group is pipelined to its node, so all
+// nodes work on the batch at the same time. Missing keys come back as empty strings.
+int cacheX_cluster_mset(CacheXCluster *cluster,
+                        const std::vector<std::pair<std::string, std::string>> &kvs);
+int cacheX_cluster_mget(CacheXCluster *cluster, const std::vector<std::string> &keys,
+                        std::vector<std::string> &values);
+
+// Index (into the list given to cacheX_cluster_connect) of the node currently serving key
+int cacheX_cluster_node_for(CacheXCluster *cluster, const std::string &key);
+
+// Close every node connection and free the handle
+void cacheX_cluster_close(CacheXCluster *cluster);
+
+#endif  // CACHEX_CLUSTER_HPP_
@@ -0,0 +1,39 @@
+#ifndef CACHEX_NEAR_CACHE_HPP_
+#define CACHEX_NEAR_CACHE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Opaque handle: a bounded in-process LRU cache in front of one server connection
+struct CacheXNearCache;
+
+struct CacheXNearCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidations = 0;  // invalidation messages received from the server
+};
+
+// Turn on server-assisted tracking for sock and cache up to capacity values locally. With no
+// prefixes the server remembers every key this connection reads. With prefixes it sends
+// invalidations for any key that starts with one of them, and only those keys are cached.
+// The socket stays owned by the caller and must only be used through the near cache from now on.
+CacheXNearCache *cacheX_near_cache_new(int sock, size_t capacity,
+                                       const std::vector<std::string> &prefixes = {});
+
+// Serve from process memory when the server has not invalidated the key since it was fetched.
+// Returns an empty string when the key does not exist.
+std::string cacheX_near_get(CacheXNearCache *cache, const std::string &key);
+
+// Write through to the server and drop the local copy
+int cacheX_near_set(CacheXNearCache *cache, const std::string &key, const std::string &value);
+int cacheX_near_del(CacheXNearCache *cache, const std::string &key);
+
+CacheXNearCacheStats cacheX_near_cache_stats(CacheXNearCache *cache);
+
+// Free the local cache. The connection keeps tracking on; close it to stop the invalidations.
+void cacheX_near_cache_free(CacheXNearCache *cache);
+
+#endif  // CACHEX_NEAR_CACHE_HPP_
@@ -8,6 +8,9 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 constexpr size_t kHeaderSize = 4;
 constexpr size_t kMaxPayloadSize = 32 * 1024 * 1024;  // 32 << 20 (32MB)
 constexpr size_t kMaxArgs = 200 * 1000;
@@ -15,14 +18,100 @@ constexpr size_t kMaxArgs = 200 * 1000;
 enum ResponseStatus {
     RES_OK = 0,
     RES_ERR = 1,
-    RES_NX = 2,  // Key not found
+    RES_NX = 2,    // Key not found
+    RES_PUSH = 3,  // Out-of-band message, not a reply to any request
+    RES_COND = 4,  // Conditional write not applied (SET NX/XX/IFVER)
+};
+
+// How a successful reply's data is encoded. v1 sends the bytes as they are; v2 tags the frame
+// with the type (see create_response_v2()).
+enum ReplyType {
+    REPLY_STR = 0,  // raw bytes
+    REPLY_INT = 1,  // 8-byte little-endian signed integer
+    REPLY_ARR = 2,  // array payload (see out_arr())
+    REPLY_NULL = 3,
+    REPLY_ERR = 4,
+    REPLY_PUSH = 5,
+    REPLY_COND = 6,
 };
 
 struct Response {
     uint32_t status = RES_OK;
+    uint8_t type = REPLY_STR;
     std::vector<uint8_t> data;
 };
 
+// Protocol v2, switched on per connection with HELLO 2. Commands are one-byte opcodes instead
+// of names, a request may carry a client-chosen ID that its reply echoes, and replies say what
+// type their payload is.
+//
+// Request:
+// +-----+----+-------+-------+------+------+------+-----+
+// | len | op | flags | nargs | [id] | len1 | arg1 | ... |
+// +-----+----+-------+-------+------+------+------+-----+
+//    4B   1B    1B      2B     4B     4B
+// Reply:
+// +-----+------+-------+------+---------+
+// | len | type | flags | [id] | payload |
+// +-----+------+-------+------+---------+
+//    4B    1B     1B     4B
+constexpr uint32_t kProtoV1 = 1;
+constexpr uint32_t kProtoV2 = 2;
+constexpr size_t kV2RequestHeader = 4;  // op, flags, nargs
+constexpr size_t kV2ReplyHeader = 2;    // type, flags
+constexpr size_t kV2MaxArgs = 0xFFFF;
+
+enum V2Flags {
+    V2_FLAG_ID = 1 << 0,     // a u32 request ID follows the header and is echoed in the reply
+    V2_FLAG_QUIET = 1 << 1,  // only reply on error
+};
+
+enum Opcode {
+    OP_GET = 1,
+    OP_SET,
+    OP_DEL,
+    OP_PFADD,
+    OP_PFCOUNT,
+    OP_PFMERGE,
+    OP_HSET,
+    OP_HGET,
+    OP_HMGET,
+    OP_HDEL,
+    OP_HGETALL,
+    OP_TRACKING,
+    OP_HOTKEYS,
+    OP_HELLO,
+    OP_INFO,
+    OP_GETSET,
+    OP_BULKLOAD,
+    OP_KEYRANGE,
+    OP_KEYPREFIX,
+    OP_SUBSCRIBE,
+    OP_UNSUBSCRIBE,
+    OP_PUBLISH,
+    OP_UNLINK,
+    OP_FLUSHALL,
+    OP_MAX,  // one past the last opcode
+};
+
+// v1 command names, indexed by opcode
+constexpr const char *kOpcodeNames[OP_MAX] = {
+    "",      "GET",   "SET",  "DEL",     "PFADD",    "PFCOUNT", "PFMERGE", "HSET",
+    "HGET",  "HMGET", "HDEL", "HGETALL", "TRACKING", "HOTKEYS", "HELLO",   "INFO",
+    "GETSET", "BULKLOAD", "KEYRANGE", "KEYPREFIX", "SUBSCRIBE", "UNSUBSCRIBE", "PUBLISH",
+    "UNLINK", "FLUSHALL",
+};
+
+// Opcode for a v1 command name, 0 if there is none
+inline uint8_t opcode_lookup(const std::string &name) {
+    for (uint8_t op = 1; op < OP_MAX; op++) {
+        if (name == kOpcodeNames[op]) {
+            return op;
+        }
+    }
+    return 0;
+}
+
 static inline int32_t read_all(int fd, void *buffer, size_t n) {
     size_t bytes_read = 0;
     errno = 0;
@@ -40,7 +129,9 @@ static inline int32_t read_all(int fd, void *buffer, size_t n) {
 static inline int32_t write_all(int fd, const void *buffer, size_t n) {
     size_t total_written = 0;
     while (total_written < n) {
-        ssize_t bytes = send(fd, (char *)buffer + total_written, n - total_written, 0);
+        // MSG_NOSIGNAL: a dead peer must surface as an error, not kill the process with SIGPIPE
+        ssize_t bytes =
+            send(fd, (char *)buffer + total_written, n - total_written, MSG_NOSIGNAL);
         if (bytes < 0) {
             if (errno == EINTR) {
                 continue;  // Interrupted system call, retry
@@ -68,7 +159,9 @@ inline void buffer_consume(std::vector<uint8_t> &buf, size_t n) {
     buf.erase(buf.begin(), buf.begin() + n);
 }
 
-static inline int32_t send_request(int fd, const std::vector<std::string> &cmd) {
+// Append one framed request to wbuf, so several requests can be pipelined in a single write
+static inline int32_t encode_request(std::vector<uint8_t> &wbuf,
+                                     const std::vector<std::string> &cmd) {
     uint32_t len = kHeaderSize;
     for (const std::string &s : cmd) {
         len += kHeaderSize + s.size();
@@ -77,7 +170,6 @@ static inline int32_t send_request(int fd, const std::vector<std::string> &cmd)
         return -1;
     }
 
-    std::vector<uint8_t> wbuf;
     buffer_append(wbuf, reinterpret_cast<const uint8_t *>(&len), kHeaderSize);
 
     uint32_t n = cmd.size();
@@ -88,7 +180,14 @@ static inline int32_t send_request(int fd, const std::vector<std::string> &cmd)
         buffer_append(wbuf, reinterpret_cast<const uint8_t *>(&slen), kHeaderSize);
         buffer_append(wbuf, reinterpret_cast<const uint8_t *>(s.data()), slen);
     }
+    return 0;
+}
 
+static inline int32_t send_request(int fd, const std::vector<std::string> &cmd) {
+    std::vector<uint8_t> wbuf;
+    if (encode_request(wbuf, cmd) < 0) {
+        return -1;
+    }
     return write_all(fd, wbuf.data(), wbuf.size());
 }
 
@@ -127,7 +226,77 @@ static inline int32_t receive_response(int fd, std::vector<uint8_t> &response_bu
     return 0;
 }
 
-void print_response(const std::vector<uint8_t> &response_buffer) {
+// Array element length that marks a missing value; no bytes follow it
+constexpr uint32_t kNilLen = 0xFFFFFFFF;
+
+// Array replies reuse the request layout: an element count followed by length-prefixed
+// strings, so clients can decode them with parse_request() unless they contain nil elements.
+inline void out_arr(Response &out, uint32_t n) {
+    out.type = REPLY_ARR;
+    buffer_append(out.data, reinterpret_cast<const uint8_t *>(&n), kHeaderSize);
+}
+
+inline void out_arr_str(Response &out, const std::string &s) {
+    uint32_t len = s.size();
+    buffer_append(out.data, reinterpret_cast<const uint8_t *>(&len), kHeaderSize);
+    buffer_append(out.data, reinterpret_cast<const uint8_t *>(s.data()), s.size());
+}
+
+inline void out_arr_nil(Response &out) {
+    buffer_append(out.data, reinterpret_cast<const uint8_t *>(&kNilLen), kHeaderSize);
+}
+
+// Integer replies are a single 8-byte little-endian signed value
+inline void out_int(Response &out, int64_t val) {
+    out.type = REPLY_INT;
+    buffer_append(out.data, reinterpret_cast<const uint8_t *>(&val), sizeof(val));
+}
+
+// Append one v2 request to wbuf. cmd[0] (the v1 command name) is not sent; the opcode replaces it.
+inline int32_t encode_request_v2(std::vector<uint8_t> &wbuf, uint8_t op, uint8_t flags,
+                                 uint32_t id, const std::vector<std::string> &cmd) {
+    uint32_t len = kV2RequestHeader + ((flags & V2_FLAG_ID) ? kHeaderSize : 0);
+    for (size_t i = 1; i < cmd.size(); i++) {
+        len += kHeaderSize + cmd[i].size();
+    }
+    if (cmd.empty() || len > kMaxPayloadSize || cmd.size() - 1 > kV2MaxArgs) {
+        return -1;
+    }
+
+    uint16_t nargs = cmd.size() - 1;
+    buffer_append(wbuf, reinterpret_cast<const uint8_t *>(&len), kHeaderSize);
+    buffer_append(wbuf, &op, 1);
+    buffer_append(wbuf, &flags, 1);
+    buffer_append(wbuf, reinterpret_cast<const uint8_t *>(&nargs), sizeof(nargs));
+    if (flags & V2_FLAG_ID) {
+        buffer_append(wbuf, reinterpret_cast<const uint8_t *>(&id), kHeaderSize);
+    }
+    for (size_t i = 1; i < cmd.size(); i++) {
+        uint32_t slen = cmd[i].size();
+        buffer_append(wbuf, reinterpret_cast<const uint8_t *>(&slen), kHeaderSize);
+        buffer_append(wbuf, reinterpret_cast<const uint8_t *>(cmd[i].data()), slen);
+    }
+    return 0;
+}
+
+// Quiet counterpart of receive_response() that splits the frame into status and payload.
+static inline int32_t read_response(int fd, Response &out) {
+    uint32_t header[2] = {0, 0};  // length, status
+    if (read_all(fd, header, sizeof(header)) < 0) {
+        return -1;
+    }
+    if (header[0] < kHeaderSize || header[0] > kMaxPayloadSize) {
+        return -1;
+    }
+    out.status = header[1];
+    out.data.resize(header[0] - kHeaderSize);
+    if (!out.data.empty() && read_all(fd, out.data.data(), out.data.size()) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+inline void print_response(const std::vector<uint8_t> &response_buffer) {
     fprintf(stderr, "[DEBUG] response_buffer (size=%lu): ", response_buffer.size());
     for (size_t i = 0; i < response_buffer.size(); i++) {
         fprintf(stderr, "%02X ", response_buffer[i]);
@@ -161,6 +330,12 @@ void print_response(const std::vector<uint8_t> &response_buffer) {
         case RES_NX:
             status_str = "NOT FOUND";
             break;
+        case RES_PUSH:
+            status_str = "PUSH";
+            break;
+        case RES_COND:
+            status_str = "CONDITION NOT MET";
+            break;
         default:
             status_str = "UNKNOWN";
             break;
@@ -199,7 +374,7 @@ static inline bool read_str(const uint8_t *&cur, const uint8_t *end, size_t len,
 // +------+-----+------+-----+------+-----+-----+------+
 // | nstr | len | str1 | len | str2 | ... | len | strn |
 // +------+-----+------+-----+------+-----+-----+------+
-int32_t parse_request(const uint8_t *data, size_t size, std::vector<std::string> &out) {
+inline int32_t parse_request(const uint8_t *data, size_t size, std::vector<std::string> &out) {
     const uint8_t *end = data + size;
     uint32_t nstr = 0;
 
@@ -222,6 +397,134 @@ int32_t parse_request(const uint8_t *data, size_t size, std::vector<std::string>
     return (data == end) ? 0 : -1;
 }
 
+// Decode an array reply; nil elements come back as empty strings with found[i] == false
+inline int32_t parse_array(const uint8_t *data, size_t size, std::vector<std::string> &out,
+                           std::vector<bool> &found) {
+    const uint8_t *end = data + size;
+    uint32_t n = 0;
+    if (!read_u32(data, end, n) || n > kMaxArgs) {
+        return -1;
+    }
+    out.clear();
+    found.clear();
+    while (out.size() < n) {
+        uint32_t len = 0;
+        if (!read_u32(data, end, len)) {
+            return -1;
+        }
+        out.emplace_back();
+        found.push_back(len != kNilLen);
+        if (len != kNilLen && !read_str(data, end, len, out.back())) {
+            return -1;
+        }
+    }
+    return (data == end) ? 0 : -1;
+}
+
+struct V2Header {
+    uint8_t op = 0;  // request opcode, or ReplyType in a reply
+    uint8_t flags = 0;
+    uint32_t id = 0;
+};
+
+// Parse a v2 request body (the bytes after len). cmd[0] is left empty so the arguments sit at
+// the same positions as in a v1 command.
+inline int32_t parse_request_v2(const uint8_t *data, size_t size, V2Header &hdr,
+                                std::vector<std::string> &cmd) {
+    const uint8_t *end = data + size;
+    if (size < kV2RequestHeader) {
+        return -1;
+    }
+    uint16_t nargs = 0;
+    hdr.op = data[0];
+    hdr.flags = data[1];
+    memcpy(&nargs, data + 2, sizeof(nargs));
+    data += kV2RequestHeader;
+    if ((hdr.flags & V2_FLAG_ID) && !read_u32(data, end, hdr.id)) {
+        return -1;
+    }
+
+    cmd.emplace_back();
+    while (cmd.size() <= nargs) {
+        uint32_t len = 0;
+        if (!read_u32(data, end, len)) {
+            return -1;
+        }
+        cmd.emplace_back();
+        if (!read_str(data, end, len, cmd.back())) {
+            return -1;
+        }
+    }
+    return (data == end) ? 0 : -1;
+}
+
+// Parse a v2 reply body (the bytes after len) into its header and a Response. The status is
+// derived from the type, so callers can treat it like a v1 reply.
+inline int32_t parse_reply_v2(const uint8_t *data, size_t size, V2Header &hdr, Response &out) {
+    const uint8_t *end = data + size;
+    if (size < kV2ReplyHeader) {
+        return -1;
+    }
+    hdr.op = data[0];
+    hdr.flags = data[1];
+    data += kV2ReplyHeader;
+    if ((hdr.flags & V2_FLAG_ID) && !read_u32(data, end, hdr.id)) {
+        return -1;
+    }
+
+    out.type = hdr.op;
+    switch (hdr.op) {
+        case REPLY_NULL:
+            out.status = RES_NX;
+            break;
+        case REPLY_ERR:
+            out.status = RES_ERR;
+            break;
+        case REPLY_PUSH:
+            out.status = RES_PUSH;
+            break;
+        case REPLY_COND:
+            out.status = RES_COND;
+            break;
+        default:
+            out.status = RES_OK;
+            break;
+    }
+    out.data.assign(data, end);
+    return 0;
+}
+
+// Frame a reply in the v2 format. Only V2_FLAG_ID is echoed from the request flags.
+inline void create_response_v2(const Response &resp, uint8_t flags, uint32_t id,
+                               std::vector<uint8_t> &out) {
+    uint8_t type = resp.type;
+    if (resp.status == RES_NX) {
+        type = REPLY_NULL;
+    } else if (resp.status == RES_ERR) {
+        type = REPLY_ERR;
+    } else if (resp.status == RES_PUSH) {
+        type = REPLY_PUSH;
+    } else if (resp.status == RES_COND) {
+        type = REPLY_COND;
+    }
+    flags &= V2_FLAG_ID;
+
+    bool has_payload = type != REPLY_NULL && type != REPLY_COND;
+    uint32_t len = kV2ReplyHeader + (flags ? kHeaderSize : 0);
+    if (has_payload) {
+        len += resp.data.size();
+    }
+    buffer_append(out, reinterpret_cast<const uint8_t *>(&len), kHeaderSize);
+    buffer_append(out, &type, 1);
+    buffer_append(out, &flags, 1);
+    if (flags) {
+        buffer_append(out, reinterpret_cast<const uint8_t *>(&id), kHeaderSize);
+    }
+    if (has_payload) {
+        buffer_append(out, resp.data.data(), resp.data.size());
+    }
+}
+
 inline void create_response(const Response &resp, std::vector<uint8_t> &out) {
     uint32_t resp_len = kHeaderSize + static_cast<uint32_t>(resp.data.size());
     uint32_t status = resp.status;
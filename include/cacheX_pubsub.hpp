@@ -0,0 +1,32 @@
+#ifndef CACHEX_PUBSUB_HPP_
+#define CACHEX_PUBSUB_HPP_
+
+#include <string>
+#include <vector>
+
+// Opaque handle: a connection that receives published messages. Messages can arrive between
+// any two replies, so the socket must only be used through these functions from now on.
+struct CacheXSubscriber;
+
+struct CacheXMessage {
+    std::string channel;
+    std::string payload;
+};
+
+CacheXSubscriber *cacheX_subscriber_new(int sock);
+
+// Returns the number of channels the connection is subscribed to afterwards, or -1 on error.
+// Messages that arrive before the reply are kept for cacheX_next_message().
+int cacheX_subscribe(CacheXSubscriber *sub, const std::vector<std::string> &channels);
+// With no channels, leave every channel
+int cacheX_unsubscribe(CacheXSubscriber *sub, const std::vector<std::string> &channels = {});
+
+// Wait up to timeout_ms (-1 = forever) for the next message. Returns 1 with msg filled in,
+// 0 on timeout, or -1 when the connection failed or the server closed it (e.g. because the
+// subscriber fell more than --pubsub-limit behind).
+int cacheX_next_message(CacheXSubscriber *sub, CacheXMessage &msg, int timeout_ms = -1);
+
+// Free the handle and close its socket
+void cacheX_subscriber_close(CacheXSubscriber *sub);
+
+#endif  // CACHEX_PUBSUB_HPP_
@@ -23,6 +23,7 @@ inline uint64_t str_hash(const uint8_t* data, size_t len) {
     return h;
 }
 
+#ifdef HASH_TABLE_SIZE  // from server.hpp; lets data-structure headers include this file alone
 // Hash function (djb2 algorithm)
 inline unsigned long hash_function(const char* str) {
     unsigned long hash = 5381;
@@ -32,5 +33,6 @@ inline unsigned long hash_function(const char* str) {
     }
     return hash % HASH_TABLE_SIZE;
 }
+#endif
 
 #endif  // COMMON_HPP_
@@ -0,0 +1,229 @@
+#ifndef HASH_OBJECT_HPP_
+#define HASH_OBJECT_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "hashmap.hpp"
+
+// Small hashes are stored packed and converted to an HMap once they outgrow either limit
+constexpr size_t kHashPackedMaxFields = 128;
+constexpr size_t kHashPackedMaxLen = 64;  // longest field or value kept packed
+
+// Packed form: every field/value pair back to back in one allocation, scanned linearly.
+// Per field that costs 8 bytes of lengths on top of the raw bytes, against an HNode, two
+// std::strings and a heap allocation in the table form.
+//
+// +------+-------+------+-------+------+-------+-----+
+// | flen | field | vlen | value | flen | field | ... |
+// +------+-------+------+-------+------+-------+-----+
+//    4B             4B
+struct HashField {
+    struct HNode node;
+    std::string field;
+    std::string value;
+};
+
+struct HashObject {
+    bool packed = true;
+    uint32_t count = 0;  // fields in the packed form
+    std::string blob;
+    HMap table;
+};
+
+struct HashLookup {
+    struct HNode node;
+    const char *data;
+    size_t len;
+};
+
+inline bool hash_field_eq(HNode *node, HNode *key) {
+    HashField *hf = container_of(node, HashField, node);
+    HashLookup *lookup = container_of(key, HashLookup, node);
+    return hf->field.size() == lookup->len &&
+           memcmp(hf->field.data(), lookup->data, lookup->len) == 0;
+}
+
+inline HashLookup hash_lookup_key(const std::string &field) {
+    HashLookup key;
+    key.data = field.data();
+    key.len = field.size();
+    key.node.hcode = str_hash((const uint8_t *)field.data(), field.size());
+    return key;
+}
+
+// Cursor over the packed blob
+struct PackedField {
+    size_t pos;  // offset of flen
+    uint32_t flen;
+    uint32_t vlen;
+
+    const char *field(const std::string &blob) const { return blob.data() + pos + 4; }
+    const char *value(const std::string &blob) const { return field(blob) + flen + 4; }
+    size_t end() const { return pos + 8 + flen + vlen; }
+};
+
+inline PackedField hash_packed_at(const std::string &blob, size_t pos) {
+    PackedField pf;
+    pf.pos = pos;
+    memcpy(&pf.flen, blob.data() + pos, 4);
+    memcpy(&pf.vlen, blob.data() + pos + 4 + pf.flen, 4);
+    return pf;
+}
+
+inline bool hash_packed_find(const HashObject &h, const std::string &field, PackedField &out) {
+    for (size_t pos = 0; pos < h.blob.size();) {
+        PackedField pf = hash_packed_at(h.blob, pos);
+        if (pf.flen == field.size() && memcmp(pf.field(h.blob), field.data(), pf.flen) == 0) {
+            out = pf;
+            return true;
+        }
+        pos = pf.end();
+    }
+    return false;
+}
+
+inline void hash_packed_append(std::string &blob, const std::string &field,
+                               const std::string &value) {
+    uint32_t flen = field.size(), vlen = value.size();
+    blob.append(reinterpret_cast<const char *>(&flen), 4);
+    blob.append(field);
+    blob.append(reinterpret_cast<const char *>(&vlen), 4);
+    blob.append(value);
+}
+
+inline void hash_table_insert(HashObject &h, const std::string &field, const std::string &value) {
+    HashField *hf = new HashField();
+    hf->field = field;
+    hf->value = value;
+    hf->node.hcode = str_hash((const uint8_t *)field.data(), field.size());
+    h.table.insert(&hf->node);
+}
+
+// Move every packed field into the table
+inline void hash_convert(HashObject &h) {
+    for (size_t pos = 0; pos < h.blob.size();) {
+        PackedField pf = hash_packed_at(h.blob, pos);
+        hash_table_insert(h, std::string(pf.field(h.blob), pf.flen),
+                          std::string(pf.value(h.blob), pf.vlen));
+        pos = pf.end();
+    }
+    h.packed = false;
+    h.count = 0;
+    std::string().swap(h.blob);
+}
+
+inline size_t hash_size(HashObject &h) { return h.packed ? h.count : h.table.size(); }
+
+inline bool hash_get(HashObject &h, const std::string &field, std::string &out) {
+    if (h.packed) {
+        PackedField pf;
+        if (!hash_packed_find(h, field, pf)) {
+            return false;
+        }
+        out.assign(pf.value(h.blob), pf.vlen);
+        return true;
+    }
+    HashLookup key = hash_lookup_key(field);
+    HNode *node = h.table.lookup(&key.node, &hash_field_eq);
+    if (!node) {
+        return false;
+    }
+    out = container_of(node, HashField, node)->value;
+    return true;
+}
+
+// Returns true if the field is new
+inline bool hash_set(HashObject &h, const std::string &field, const std::string &value) {
+    if (h.packed) {
+        PackedField pf;
+        if (hash_packed_find(h, field, pf)) {
+            if (value.size() <= kHashPackedMaxLen) {
+                uint32_t vlen = value.size();
+                size_t vpos = pf.pos + 8 + pf.flen;
+                h.blob.replace(vpos, pf.vlen, value);
+                memcpy(&h.blob[vpos - 4], &vlen, 4);
+                return false;
+            }
+        } else if (h.count < kHashPackedMaxFields && field.size() <= kHashPackedMaxLen &&
+                   value.size() <= kHashPackedMaxLen) {
+            hash_packed_append(h.blob, field, value);
+            h.count++;
+            return true;
+        }
+        hash_convert(h);
+    }
+
+    HashLookup key = hash_lookup_key(field);
+    HNode *node = h.table.lookup(&key.node, &hash_field_eq);
+    if (node) {
+        container_of(node, HashField, node)->value = value;
+        return false;
+    }
+    hash_table_insert(h, field, value);
+    return true;
+}
+
+// Returns true if the field existed
+inline bool hash_del(HashObject &h, const std::string &field) {
+    if (h.packed) {
+        PackedField pf;
+        if (!hash_packed_find(h, field, pf)) {
+            return false;
+        }
+        h.blob.erase(pf.pos, pf.end() - pf.pos);
+        h.count--;
+        return true;
+    }
+    HashLookup key = hash_lookup_key(field);
+    HNode *node = h.table.hm_delete(&key.node, &hash_field_eq);
+    if (!node) {
+        return false;
+    }
+    delete container_of(node, HashField, node);
+    return true;
+}
+
+// Calls f(field, value) for every pair, in no particular order
+template <typename F>
+inline void hash_foreach(HashObject &h, F f) {
+    if (h.packed) {
+        for (size_t pos = 0; pos < h.blob.size();) {
+            PackedField pf = hash_packed_at(h.blob, pos);
+            f(std::string(pf.field(h.blob), pf.flen), std::string(pf.value(h.blob), pf.vlen));
+            pos = pf.end();
+        }
+        return;
+    }
+    h.table.foreach (
+        [](HNode *node, void *arg) {
+            HashField *hf = container_of(node, HashField, node);
+            (*(F *)arg)(hf->field, hf->value);
+            return true;
+        },
+        &f);
+}
+
+inline void hash_clear(HashObject &h) {
+    if (!h.packed) {
+        std::vector<HNode *> nodes;
+        h.table.foreach (
+            [](HNode *node, void *arg) {
+                ((std::vector<HNode *> *)arg)->push_back(node);
+                return true;
+            },
+            &nodes);
+        for (HNode *node : nodes) {
+            delete container_of(node, HashField, node);
+        }
+        h.table.clear();
+    }
+    h = HashObject{};
+}
+
+#endif  // HASH_OBJECT_HPP_
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <initializer_list>
+
 constexpr size_t kRehasingWork = 128;
 constexpr size_t kMaxLoadFactor = 8;
 
@@ -143,6 +145,33 @@ struct HMap {
 
     size_t size() { return this->newer.size + this->older.size; }
 
+    // Make room for n more keys in one resize, so inserting them never triggers a rehash.
+    // A resize also absorbs any rehash in progress.
+    void reserve(size_t n) {
+        size_t want = (size() + n) / kMaxLoadFactor + 1;
+        size_t slots = 4;
+        while (slots < want) {
+            slots *= 2;
+        }
+        if (this->newer.tab && this->newer.mask + 1 >= slots) {
+            return;
+        }
+        HTab bigger;
+        bigger.init(slots);
+        for (HTab *from : {&this->newer, &this->older}) {
+            for (size_t i = 0; from->tab && i <= from->mask; i++) {
+                for (HNode *node = from->tab[i], *next; node != nullptr; node = next) {
+                    next = node->next;
+                    bigger.insert(node);
+                }
+            }
+            free(from->tab);
+            *from = HTab{};
+        }
+        this->newer = bigger;
+        this->migrate_pos = 0;
+    }
+
     void foreach (bool (*f)(HNode *, void *), void *arg) {
         this->newer.foreach (f, arg) && this->older.foreach (f, arg);
     }
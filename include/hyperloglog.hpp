@@ -0,0 +1,298 @@
+#ifndef HYPERLOGLOG_HPP_
+#define HYPERLOGLOG_HPP_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+constexpr uint32_t kHllP = 14;                   // index bits
+constexpr uint32_t kHllRegisters = 1 << kHllP;  // 16384
+constexpr uint32_t kHllQ = 64 - kHllP;          // hash bits left for the rank
+constexpr uint32_t kHllBits = 6;                // enough for ranks up to kHllQ + 1 = 51
+constexpr size_t kHllDenseSize = kHllRegisters * kHllBits / 8;  // 12288 bytes
+// A sparse sketch costs 4 bytes per non-zero register; past this it is no longer smaller
+// than the dense form by a useful margin
+constexpr size_t kHllSparseMax = 768;
+
+// Low cardinalities use a sorted list of (index << 8 | rank) for the non-zero registers, so an
+// almost empty sketch costs a few bytes instead of 12 KB. It turns dense once it outgrows
+// kHllSparseMax entries.
+//
+// Dense registers are packed 6 bits each, 4 registers per 3 bytes:
+//   byte 0       byte 1       byte 2
+//   [r1lo r0]   [r2lo r1hi]  [r3 r2hi]
+struct HyperLogLog {
+    bool dense = false;
+    std::vector<uint32_t> sparse;
+    std::vector<uint8_t> regs;  // kHllDenseSize bytes once dense
+};
+
+// MurmurHash64A
+inline uint64_t hll_hash(const uint8_t *data, size_t len) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0xadc83b19ULL ^ (len * m);
+
+    const uint8_t *end = data + (len & ~(size_t)7);
+    for (; data != end; data += 8) {
+        uint64_t k;
+        memcpy(&k, data, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (len & 7) {
+        case 7:
+            h ^= (uint64_t)data[6] << 48;  // fall through
+        case 6:
+            h ^= (uint64_t)data[5] << 40;  // fall through
+        case 5:
+            h ^= (uint64_t)data[4] << 32;  // fall through
+        case 4:
+            h ^= (uint64_t)data[3] << 24;  // fall through
+        case 3:
+            h ^= (uint64_t)data[2] << 16;  // fall through
+        case 2:
+            h ^= (uint64_t)data[1] << 8;  // fall through
+        case 1:
+            h ^= (uint64_t)data[0];
+            h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// Unpack the dense registers into one byte each. The byte-per-register form is what merge and
+// estimation work on: plain loops over uint8_t arrays that the compiler vectorizes.
+inline void hll_dense_unpack(const uint8_t *packed, uint8_t *out) {
+    for (size_t i = 0; i < kHllRegisters / 4; i++) {
+        uint32_t b0 = packed[i * 3], b1 = packed[i * 3 + 1], b2 = packed[i * 3 + 2];
+        out[i * 4] = b0 & 63;
+        out[i * 4 + 1] = ((b0 >> 6) | (b1 << 2)) & 63;
+        out[i * 4 + 2] = ((b1 >> 4) | (b2 << 4)) & 63;
+        out[i * 4 + 3] = b2 >> 2;
+    }
+}
+
+inline void hll_dense_pack(const uint8_t *in, uint8_t *packed) {
+    for (size_t i = 0; i < kHllRegisters / 4; i++) {
+        uint32_t r0 = in[i * 4], r1 = in[i * 4 + 1], r2 = in[i * 4 + 2], r3 = in[i * 4 + 3];
+        packed[i * 3] = (uint8_t)(r0 | (r1 << 6));
+        packed[i * 3 + 1] = (uint8_t)((r1 >> 2) | (r2 << 4));
+        packed[i * 3 + 2] = (uint8_t)((r2 >> 4) | (r3 << 2));
+    }
+}
+
+inline uint32_t hll_dense_get(const uint8_t *packed, uint32_t idx) {
+    size_t bit = (size_t)idx * kHllBits;
+    uint32_t word = packed[bit / 8] | (bit / 8 + 1 < kHllDenseSize ? packed[bit / 8 + 1] << 8 : 0);
+    return (word >> (bit % 8)) & 63;
+}
+
+inline void hll_dense_set(uint8_t *packed, uint32_t idx, uint32_t val) {
+    size_t bit = (size_t)idx * kHllBits;
+    uint32_t shift = bit % 8;
+    packed[bit / 8] = (uint8_t)((packed[bit / 8] & ~(63u << shift)) | (val << shift));
+    if (shift > 2) {
+        uint32_t hi = 8 - shift;  // bits that went into the first byte
+        packed[bit / 8 + 1] = (uint8_t)((packed[bit / 8 + 1] & ~(63u >> hi)) | (val >> hi));
+    }
+}
+
+// Checks for a sketch read from outside, e.g. a file: every index in range, every rank one that
+// hll_add() could produce, and sparse items in strictly increasing index order as hll_add()'s
+// binary search expects. items holds count native-endian uint32_t, possibly unaligned.
+inline bool hll_sparse_valid(const uint8_t *items, size_t count) {
+    uint32_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t item = 0;
+        memcpy(&item, items + i * sizeof(item), sizeof(item));
+        uint32_t idx = item >> 8, rank = item & 0xFF;
+        if (idx >= kHllRegisters || rank == 0 || rank > kHllQ + 1 || (i > 0 && idx <= prev)) {
+            return false;
+        }
+        prev = idx;
+    }
+    return true;
+}
+
+inline bool hll_dense_valid(const uint8_t *packed) {
+    for (uint32_t idx = 0; idx < kHllRegisters; idx++) {
+        if (hll_dense_get(packed, idx) > kHllQ + 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Expand a sketch of either encoding into kHllRegisters bytes
+inline void hll_unpack(const HyperLogLog &hll, uint8_t *out) {
+    if (hll.dense) {
+        hll_dense_unpack(hll.regs.data(), out);
+        return;
+    }
+    memset(out, 0, kHllRegisters);
+    for (uint32_t item : hll.sparse) {
+        out[item >> 8] = item & 0xFF;
+    }
+}
+
+// Rebuild a sketch from unpacked registers, choosing the smaller encoding
+inline void hll_load(HyperLogLog &hll, const uint8_t *regs) {
+    size_t nonzero = kHllRegisters - std::count(regs, regs + kHllRegisters, 0);
+    hll.sparse.clear();
+    if (nonzero <= kHllSparseMax) {
+        hll.dense = false;
+        hll.regs.clear();
+        hll.regs.shrink_to_fit();
+        for (uint32_t i = 0; i < kHllRegisters; i++) {
+            if (regs[i]) {
+                hll.sparse.push_back(i << 8 | regs[i]);
+            }
+        }
+        return;
+    }
+    hll.dense = true;
+    hll.sparse.shrink_to_fit();
+    hll.regs.resize(kHllDenseSize);
+    hll_dense_pack(regs, hll.regs.data());
+}
+
+inline void hll_to_dense(HyperLogLog &hll) {
+    std::vector<uint8_t> regs(kHllRegisters);
+    hll_unpack(hll, regs.data());
+    hll.dense = true;
+    hll.sparse.clear();
+    hll.sparse.shrink_to_fit();
+    hll.regs.resize(kHllDenseSize);
+    hll_dense_pack(regs.data(), hll.regs.data());
+}
+
+// Returns true if a register changed, i.e. the estimate may have changed
+inline bool hll_add(HyperLogLog &hll, const uint8_t *data, size_t len) {
+    uint64_t hash = hll_hash(data, len);
+    uint32_t idx = hash & (kHllRegisters - 1);
+    // The rank is the position of the first set bit in the remaining hash bits; the sentinel
+    // bit caps it at kHllQ + 1
+    uint32_t rank = __builtin_ctzll((hash >> kHllP) | (1ULL << kHllQ)) + 1;
+
+    if (hll.dense) {
+        if (hll_dense_get(hll.regs.data(), idx) >= rank) {
+            return false;
+        }
+        hll_dense_set(hll.regs.data(), idx, rank);
+        return true;
+    }
+
+    auto it = std::lower_bound(hll.sparse.begin(), hll.sparse.end(), idx << 8);
+    if (it != hll.sparse.end() && (*it >> 8) == idx) {
+        if ((*it & 0xFF) >= rank) {
+            return false;
+        }
+        *it = idx << 8 | rank;
+        return true;
+    }
+    hll.sparse.insert(it, idx << 8 | rank);
+    if (hll.sparse.size() > kHllSparseMax) {
+        hll_to_dense(hll);
+    }
+    return true;
+}
+
+// acc[i] = max(acc[i], regs of hll). For dense sketches this is one unpack plus a byte-wise
+// max over 16 KB, which compiles to packed max instructions.
+inline void hll_merge_into(uint8_t *__restrict acc, const HyperLogLog &hll) {
+    if (!hll.dense) {
+        for (uint32_t item : hll.sparse) {
+            acc[item >> 8] = std::max<uint8_t>(acc[item >> 8], item & 0xFF);
+        }
+        return;
+    }
+    alignas(64) uint8_t regs[kHllRegisters];
+    hll_dense_unpack(hll.regs.data(), regs);
+    for (size_t i = 0; i < kHllRegisters; i++) {
+        acc[i] = std::max(acc[i], regs[i]);
+    }
+}
+
+// Ertl, "New cardinality estimation algorithms for HyperLogLog sketches" (2017): the improved
+// raw estimator needs only the histogram of register values, with no bias tables or
+// linear-counting switch-over.
+inline double hll_sigma(double x) {
+    if (x == 1.0) {
+        return INFINITY;
+    }
+    double y = 1.0, z = x, prev;
+    do {
+        x *= x;
+        prev = z;
+        z += x * y;
+        y += y;
+    } while (prev != z);
+    return z;
+}
+
+inline double hll_tau(double x) {
+    if (x == 0.0 || x == 1.0) {
+        return 0.0;
+    }
+    double y = 1.0, z = 1 - x, prev;
+    do {
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    } while (prev != z);
+    return z / 3;
+}
+
+inline uint64_t hll_estimate_hist(const uint32_t *hist) {
+    const double m = kHllRegisters;
+    double z = m * hll_tau((m - hist[kHllQ + 1]) / m);
+    for (int k = kHllQ; k >= 1; k--) {
+        z += hist[k];
+        z *= 0.5;
+    }
+    z += m * hll_sigma(hist[0] / m);
+    return (uint64_t)llroundl(0.5 / log(2) * m * m / z);
+}
+
+// Estimate from unpacked registers. Counting into four histograms breaks the store-to-load
+// dependency between neighbouring registers that usually share a value.
+inline uint64_t hll_estimate(const uint8_t *regs) {
+    uint32_t hist[4][64] = {};
+    for (size_t i = 0; i < kHllRegisters; i += 4) {
+        hist[0][regs[i]]++;
+        hist[1][regs[i + 1]]++;
+        hist[2][regs[i + 2]]++;
+        hist[3][regs[i + 3]]++;
+    }
+    for (size_t r = 0; r < 64; r++) {
+        hist[0][r] += hist[1][r] + hist[2][r] + hist[3][r];
+    }
+    return hll_estimate_hist(hist[0]);
+}
+
+inline uint64_t hll_count(const HyperLogLog &hll) {
+    if (!hll.dense) {
+        uint32_t hist[64] = {};
+        hist[0] = kHllRegisters - hll.sparse.size();
+        for (uint32_t item : hll.sparse) {
+            hist[item & 0xFF]++;
+        }
+        return hll_estimate_hist(hist);
+    }
+    alignas(64) uint8_t regs[kHllRegisters];
+    hll_dense_unpack(hll.regs.data(), regs);
+    return hll_estimate(regs);
+}
+
+#endif  // HYPERLOGLOG_HPP_
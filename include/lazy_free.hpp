@@ -0,0 +1,90 @@
+#ifndef LAZY_FREE_HPP_
+#define LAZY_FREE_HPP_
+
+#include <semaphore.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// A background thread that frees memory the event loop has already unlinked, so a large
+// delete costs the loop one push instead of the whole free(). Jobs go on a lock-free stack
+// (Treiber): the loop pushes with a compare-and-swap, and the thread takes the whole stack
+// with one exchange, so there is no ABA problem and no lock on either side. The thread
+// sleeps on a semaphore, posted only when a push finds the stack empty.
+struct LazyFreeJob {
+    LazyFreeJob *next = nullptr;
+    std::function<void()> free;
+};
+
+struct LazyFree {
+    std::atomic<LazyFreeJob *> head{nullptr};
+    std::atomic<uint64_t> pending{0};  // jobs pushed and not yet done
+    std::atomic<bool> stop{false};
+    sem_t sem;
+    std::thread thread;
+};
+
+inline void lazy_free_worker(LazyFree *lf) {
+    while (true) {
+        LazyFreeJob *jobs = lf->head.exchange(nullptr, std::memory_order_acquire);
+        if (!jobs) {
+            if (lf->stop.load(std::memory_order_acquire)) {
+                return;
+            }
+            sem_wait(&lf->sem);
+            continue;
+        }
+        // The stack is newest first; free in the order things were deleted
+        LazyFreeJob *fifo = nullptr;
+        while (jobs) {
+            LazyFreeJob *next = jobs->next;
+            jobs->next = fifo;
+            fifo = jobs;
+            jobs = next;
+        }
+        while (fifo) {
+            LazyFreeJob *next = fifo->next;
+            fifo->free();
+            delete fifo;
+            fifo = next;
+            lf->pending.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Returns -1 if the semaphore can't be created
+inline int lazy_free_init(LazyFree &lf) {
+    if (sem_init(&lf.sem, 0, 0) < 0) {
+        return -1;
+    }
+    lf.thread = std::thread(lazy_free_worker, &lf);
+    return 0;
+}
+
+inline void lazy_free_submit(LazyFree &lf, std::function<void()> free) {
+    LazyFreeJob *job = new LazyFreeJob{nullptr, std::move(free)};
+    lf.pending.fetch_add(1, std::memory_order_relaxed);
+    LazyFreeJob *old = lf.head.load(std::memory_order_relaxed);
+    do {
+        job->next = old;
+    } while (!lf.head.compare_exchange_weak(old, job, std::memory_order_release,
+                                            std::memory_order_relaxed));
+    if (!old) {
+        sem_post(&lf.sem);
+    }
+}
+
+// Free everything still queued and join the thread
+inline void lazy_free_destroy(LazyFree &lf) {
+    if (!lf.thread.joinable()) {
+        return;
+    }
+    lf.stop.store(true, std::memory_order_release);
+    sem_post(&lf.sem);
+    lf.thread.join();
+    sem_destroy(&lf.sem);
+}
+
+#endif  // LAZY_FREE_HPP_
@@ -0,0 +1,30 @@
+#ifndef LIST_HPP_
+#define LIST_HPP_
+
+// Intrusive circular doubly linked list. A head node is initialized to point at itself; items
+// embed a DList and are recovered with container_of().
+struct DList {
+    DList *prev = this;
+    DList *next = this;
+};
+
+inline bool dlist_empty(const DList *node) { return node->next == node; }
+
+// Whether the item is currently linked into a list
+inline bool dlist_linked(const DList *node) { return node->next != node; }
+
+inline void dlist_detach(DList *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = node;
+}
+
+// Link rookie right after target, e.g. at the front when target is the head
+inline void dlist_insert_after(DList *target, DList *rookie) {
+    rookie->prev = target;
+    rookie->next = target->next;
+    target->next->prev = rookie;
+    target->next = rookie;
+}
+
+#endif  // LIST_HPP_
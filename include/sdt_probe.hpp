@@ -0,0 +1,70 @@
+#ifndef SDT_PROBE_HPP_
+#define SDT_PROBE_HPP_
+
+// A minimal stand-in for <sys/sdt.h>, used by trace.hpp when systemtap-sdt-dev is not
+// installed. It emits the same thing as the DTRACE_PROBEn macros there: a nop at the probe
+// site and a ".note.stapsdt" ELF note naming the provider, the probe and where each argument
+// lives ("-4@%edi" is a signed 4-byte value in edi). bpftrace, perf and readelf -n read these
+// notes. There are no semaphores, so arguments are always computed. GCC or Clang on ELF only.
+
+#include <type_traits>
+
+#if defined(__LP64__)
+#define CACHEX_SDT_ADDR ".8byte"
+#else
+#define CACHEX_SDT_ADDR ".4byte"
+#endif
+
+// The size of an argument, negative when it is signed. The asm template prints it with %n,
+// which negates it again.
+#define CACHEX_SDT_SIZE(x)                                                          \
+    (std::is_signed<typename std::decay<decltype(x)>::type>::value ? (int)sizeof(x) \
+                                                                    : -(int)sizeof(x))
+#define CACHEX_SDT_OPERAND(n, x) [s##n] "n"(CACHEX_SDT_SIZE(x)), [a##n] "nor"(x)
+
+#define CACHEX_SDT_NOTE(provider, name, args)                               \
+    "990: nop\n"                                                            \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+    ".balign 4\n"                                                           \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+    "991: .asciz \"stapsdt\"\n"                                             \
+    "992: .balign 4\n"                                                      \
+    "993: " CACHEX_SDT_ADDR " 990b\n"                                        \
+    CACHEX_SDT_ADDR " _.stapsdt.base\n"                                     \
+    CACHEX_SDT_ADDR " 0\n" /* no semaphore */                               \
+    ".asciz \"" #provider "\"\n"                                            \
+    ".asciz \"" #name "\"\n"                                                \
+    ".asciz \"" args "\"\n"                                                 \
+    "994: .balign 4\n"                                                      \
+    ".popsection\n"                                                         \
+    ".ifndef _.stapsdt.base\n"                                              \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                                \
+    ".hidden _.stapsdt.base\n"                                              \
+    "_.stapsdt.base: .space 1\n"                                            \
+    ".size _.stapsdt.base, 1\n"                                             \
+    ".popsection\n"                                                         \
+    ".endif\n"
+
+#define CACHEX_SDT_ARG(n) "%n[s" #n "]@%[a" #n "]"
+
+#define CACHEX_SDT_ARGS2 CACHEX_SDT_ARG(1) " " CACHEX_SDT_ARG(2)
+#define CACHEX_SDT_ARGS3 CACHEX_SDT_ARGS2 " " CACHEX_SDT_ARG(3)
+#define CACHEX_SDT_ARGS4 CACHEX_SDT_ARGS3 " " CACHEX_SDT_ARG(4)
+
+#define DTRACE_PROBE2(provider, name, a, b)                                \
+    __asm__ __volatile__(CACHEX_SDT_NOTE(provider, name, CACHEX_SDT_ARGS2) \
+                         :                                                 \
+                         : CACHEX_SDT_OPERAND(1, a), CACHEX_SDT_OPERAND(2, b))
+#define DTRACE_PROBE3(provider, name, a, b, c)                                 \
+    __asm__ __volatile__(CACHEX_SDT_NOTE(provider, name, CACHEX_SDT_ARGS3)     \
+                         :                                                     \
+                         : CACHEX_SDT_OPERAND(1, a), CACHEX_SDT_OPERAND(2, b), \
+                           CACHEX_SDT_OPERAND(3, c))
+#define DTRACE_PROBE4(provider, name, a, b, c, d)                              \
+    __asm__ __volatile__(CACHEX_SDT_NOTE(provider, name, CACHEX_SDT_ARGS4)     \
+                         :                                                     \
+                         : CACHEX_SDT_OPERAND(1, a), CACHEX_SDT_OPERAND(2, b), \
+                           CACHEX_SDT_OPERAND(3, c), CACHEX_SDT_OPERAND(4, d))
+
+#endif  // SDT_PROBE_HPP_
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+#include <deque>
+#include <memory>
+#include <string>
 #include <vector>
 
 #define PORT 6379
@@ -12,15 +15,57 @@
 
 // Connection struct to store client socket and buffers
 struct Conn {
-    int fd;
-    bool want_read;
-    bool want_write;
-    bool want_close;
+    int fd = -1;
+    bool want_read = true;
+    bool want_write = false;
+    bool want_close = false;
     std::vector<uint8_t> incoming;
     std::vector<uint8_t> outgoing;
+    uint64_t id = 0;     // unique for the server's lifetime, unlike the fd
+    uint32_t proto = 1;  // wire protocol version, switched by HELLO
+    // Client-side caching: send invalidations for keys this connection read, or, when prefixes
+    // is non-empty, for every key starting with one of them
+    bool tracking = false;
+    std::vector<std::string> prefixes;
+    bool flush_queued = false;  // on the deferred write list for pushed messages
+    bool blocked = false;       // waiting for a spilled value; requests stay queued meanwhile
+    // Pub/sub. Published messages are encoded once and the same buffer is queued on every
+    // subscriber; shared is sent before outgoing, which always holds the newest bytes.
+    std::vector<std::string> channels;
+    std::deque<std::shared_ptr<const std::vector<uint8_t>>> shared;
+    size_t shared_sent = 0;   // bytes of shared.front() already sent
+    size_t shared_bytes = 0;  // not yet sent from shared
+    // Fair scheduling: each turn serves a bounded number of requests, and a connection with
+    // work left over waits on the run queue for its next turn
+    bool unread = false;      // stopped reading before the socket was drained
+    bool run_queued = false;  // on the run queue
 };
 
-void start_server();
+// Runtime settings for start_server(), filled from the command line in main.cpp
+struct ServerOptions {
+    int port = PORT;
+    std::string unix_path;       // also listen on this Unix domain socket when set
+    bool tcp_nodelay = true;     // disable Nagle on accepted TCP connections
+    int busy_poll_us = 0;        // SO_BUSY_POLL budget for accepted TCP connections, 0 = off
+    uint32_t hotkey_sample = 1;  // track 1 in N key accesses for HOTKEYS, 0 = off
+    std::string handoff_path;    // take over from the process listening here, then listen here
+    int cpu = -1;                // pin the event loop to this core, -1 = off
+    uint32_t spin_us = 0;        // poll without blocking for up to this long before sleeping
+    // Tiered storage: when spill_dir is set, string values beyond spill_mem bytes move to a
+    // log in that directory, least recently used first
+    std::string spill_dir;
+    uint64_t spill_mem = 1ULL << 30;
+    uint64_t spill_segment = 64ULL << 20;  // log segment size, the unit of compaction
+    uint32_t io_threads = 2;               // threads reading spilled values back
+    bool key_index = false;  // keep keys in order as well, for KEYRANGE and KEYPREFIX
+    bool keyspace_events = false;      // publish writes to __keyspace__:<key>
+    uint64_t pubsub_limit = 32 << 20;  // drop a subscriber with more output pending than this
+    uint32_t turn_requests = 64;       // requests served per connection per turn, at least 1
+    uint64_t turn_bytes = 256 << 10;   // bytes read per connection per turn
+    uint64_t output_limit = 8 << 20;   // serve no more requests while this much output is pending
+};
+
+void start_server(const ServerOptions &opts = ServerOptions());
 void store_set_command(const char *key, const char *value);
 const char *fetch_get_command(const char *key);
 
@@ -0,0 +1,129 @@
+#ifndef SNAPSHOT_HPP_
+#define SNAPSHOT_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// Serialized keyspace: a header, one record per key, then an end marker. Values are encoded
+// per type by the server; this file only frames them.
+//
+// +-------+---------+   +------+-----+------+-----+------+-------+         +-----+
+// | magic | version |   | type | ver | klen | key | vlen | value |   ...   | END |
+// +-------+---------+   +------+-----+------+-----+------+-------+         +-----+
+//    4B       4B           1B     8B    4B           4B                      1B
+// ver is the entry's CAS version, kept so tokens that clients hold stay valid. Version 1
+// streams, written by servers older than CAS, have no ver field; the reader reports 0 for it.
+constexpr uint8_t kSnapshotMagic[4] = {'C', 'X', 'S', 'N'};
+constexpr uint32_t kSnapshotVersion = 2;
+constexpr size_t kSnapshotHeaderSize = 8;
+constexpr size_t kRecordHeaderSize = 1 + 8 + 4;  // type, ver, klen
+constexpr size_t kRecordHeaderSizeV1 = 1 + 4;    // type, klen
+
+inline size_t snapshot_record_header_size(uint32_t version) {
+    return version == 1 ? kRecordHeaderSizeV1 : kRecordHeaderSize;
+}
+
+enum RecordType {
+    REC_STR = 0,
+    REC_HLL = 1,   // [u8 dense][sparse u32 items | packed dense registers]
+    REC_HASH = 2,  // array payload of field/value pairs
+    REC_END = 0xFF,
+};
+
+struct SnapshotRecord {
+    uint8_t type = REC_END;
+    uint64_t version = 0;
+    std::string key;
+    std::string value;
+};
+
+inline void snapshot_put_header(std::vector<uint8_t> &buf) {
+    buf.insert(buf.end(), kSnapshotMagic, kSnapshotMagic + 4);
+    const uint8_t *version = reinterpret_cast<const uint8_t *>(&kSnapshotVersion);
+    buf.insert(buf.end(), version, version + 4);
+}
+
+inline void snapshot_put_record(std::vector<uint8_t> &buf, uint8_t type, uint64_t version,
+                                const std::string &key, const uint8_t *value, size_t vlen) {
+    uint32_t klen = key.size(), len = vlen;
+    buf.push_back(type);
+    buf.insert(buf.end(), reinterpret_cast<const uint8_t *>(&version),
+               reinterpret_cast<const uint8_t *>(&version) + 8);
+    buf.insert(buf.end(), reinterpret_cast<const uint8_t *>(&klen),
+               reinterpret_cast<const uint8_t *>(&klen) + 4);
+    buf.insert(buf.end(), key.begin(), key.end());
+    buf.insert(buf.end(), reinterpret_cast<const uint8_t *>(&len),
+               reinterpret_cast<const uint8_t *>(&len) + 4);
+    buf.insert(buf.end(), value, value + vlen);
+}
+
+inline void snapshot_put_end(std::vector<uint8_t> &buf) { buf.push_back(REC_END); }
+
+// Returns the format version of a valid header (1 or kSnapshotVersion), -1 otherwise. size
+// must be at least kSnapshotHeaderSize.
+inline int32_t snapshot_check_header(const uint8_t *data) {
+    uint32_t version = 0;
+    memcpy(&version, data + 4, 4);
+    if (memcmp(data, kSnapshotMagic, 4) != 0 || (version != 1 && version != kSnapshotVersion)) {
+        return -1;
+    }
+    return (int32_t)version;
+}
+
+// Size of the record at data, 0 if more bytes are needed, -1 if it is malformed. An END record
+// has size 1. version is the one from the stream's header.
+inline int64_t snapshot_record_size(const uint8_t *data, size_t size,
+                                    uint32_t version = kSnapshotVersion) {
+    if (size < 1) {
+        return 0;
+    }
+    if (data[0] == REC_END) {
+        return 1;
+    }
+    if (data[0] > REC_HASH) {
+        return -1;
+    }
+    size_t header = snapshot_record_header_size(version);
+    if (size < header) {
+        return 0;
+    }
+    uint32_t klen = 0, vlen = 0;
+    memcpy(&klen, data + header - 4, 4);
+    if (size < header + klen + 4) {
+        return 0;
+    }
+    memcpy(&vlen, data + header + klen, 4);
+    size_t total = header + (size_t)klen + 4 + vlen;
+    return size < total ? 0 : (int64_t)total;
+}
+
+// Decode the record at data. Returns its size, 0 if more bytes are needed, -1 if malformed.
+// An END record decodes to type REC_END and size 1.
+inline int64_t snapshot_next(const uint8_t *data, size_t size, SnapshotRecord &out,
+                             uint32_t version = kSnapshotVersion) {
+    int64_t total = snapshot_record_size(data, size, version);
+    if (total <= 0) {
+        return total;
+    }
+    out.type = data[0];
+    if (out.type == REC_END) {
+        return 1;
+    }
+    size_t header = snapshot_record_header_size(version);
+    uint32_t klen = 0;
+    out.version = 0;
+    if (version != 1) {
+        memcpy(&out.version, data + 1, 8);
+    }
+    memcpy(&klen, data + header - 4, 4);
+    out.key.assign(reinterpret_cast<const char *>(data + header), klen);
+    out.value.assign(reinterpret_cast<const char *>(data + header + klen + 4),
+                     (size_t)total - header - klen - 4);
+    return total;
+}
+
+#endif  // SNAPSHOT_HPP_
@@ -0,0 +1,125 @@
+#ifndef SPILL_LOG_HPP_
+#define SPILL_LOG_HPP_
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+// Append-only value log for tiered storage, split into segment files. Records are written
+// back to back and never modified; a value is addressed by its segment and the offset of its
+// bytes. The key is stored too, so compaction can tell whether a record is still referenced.
+//
+// +------+------+-----+-------+------+------+-----+-------+
+// | klen | vlen | key | value | klen | vlen | key | value | ...
+// +------+------+-----+-------+------+------+-----+-------+
+//    4B     4B
+// Segment files are unlinked as soon as they are created: the log only extends memory, so it
+// has nothing to offer a restarted process, and the kernel reclaims it even after a crash.
+constexpr size_t kSpillRecordHeader = 8;
+
+struct SpillSegment {
+    uint32_t id = 0;
+    int fd = -1;
+    uint64_t size = 0;  // bytes written
+    uint64_t live = 0;  // bytes of records still referenced by an entry
+    bool compacting = false;
+
+    ~SpillSegment() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+// Size of the record holding a value of vlen bytes under key
+inline uint64_t spill_record_size(size_t klen, size_t vlen) {
+    return kSpillRecordHeader + klen + vlen;
+}
+
+// Create an anonymous segment file in dir. Returns the fd or -1.
+inline int spill_create_file(const std::string &dir) {
+    std::string path = dir + "/cacheX-spill-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd >= 0) {
+        unlink(path.c_str());
+    }
+    return fd;
+}
+
+// Append a record to buf. Returns the offset of the value within the record.
+inline size_t spill_put_record(std::vector<uint8_t> &buf, const std::string &key,
+                               const std::string &value) {
+    uint32_t klen = key.size(), vlen = value.size();
+    buf.insert(buf.end(), reinterpret_cast<const uint8_t *>(&klen),
+               reinterpret_cast<const uint8_t *>(&klen) + 4);
+    buf.insert(buf.end(), reinterpret_cast<const uint8_t *>(&vlen),
+               reinterpret_cast<const uint8_t *>(&vlen) + 4);
+    buf.insert(buf.end(), key.begin(), key.end());
+    buf.insert(buf.end(), value.begin(), value.end());
+    return kSpillRecordHeader + klen;
+}
+
+// Decode the record at data: the key, and the value's position relative to data. Returns the
+// record size, or -1 if it is truncated.
+inline int64_t spill_next(const uint8_t *data, size_t size, std::string &key, size_t &voff,
+                          uint32_t &vlen) {
+    uint32_t klen = 0;
+    if (size < kSpillRecordHeader) {
+        return -1;
+    }
+    memcpy(&klen, data, 4);
+    memcpy(&vlen, data + 4, 4);
+    uint64_t total = spill_record_size(klen, vlen);
+    if (size < total) {
+        return -1;
+    }
+    key.assign(reinterpret_cast<const char *>(data + kSpillRecordHeader), klen);
+    voff = kSpillRecordHeader + klen;
+    return (int64_t)total;
+}
+
+// pread()/pwrite() that retry short transfers. Return 0 or -1 with errno set.
+inline int spill_pread(int fd, void *buf, size_t len, uint64_t off) {
+    uint8_t *p = static_cast<uint8_t *>(buf);
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, (off_t)off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;  // the file is shorter than the record
+            }
+            return -1;
+        }
+        p += n;
+        off += (uint64_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+inline int spill_pwrite(int fd, const void *buf, size_t len, uint64_t off) {
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        p += n;
+        off += (uint64_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+#endif  // SPILL_LOG_HPP_
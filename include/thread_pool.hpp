@@ -0,0 +1,142 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads for blocking calls (disk reads) the event loop must not wait on. work() runs
+// on a worker. done() runs later on the loop thread, from thread_pool_complete(), which the
+// loop calls when the pool's eventfd (register it with epoll) becomes readable.
+struct PoolJob {
+    std::function<void()> work;
+    std::function<void()> done;
+};
+
+struct ThreadPool {
+    int efd = -1;
+    std::vector<std::thread> threads;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<PoolJob> queue;     // waiting for a worker
+    std::vector<PoolJob> finished;  // waiting for the loop
+    bool stop = false;
+};
+
+inline void thread_pool_worker(ThreadPool *tp) {
+    while (true) {
+        PoolJob job;
+        {
+            std::unique_lock<std::mutex> lock(tp->mu);
+            tp->cv.wait(lock, [tp] { return tp->stop || !tp->queue.empty(); });
+            if (tp->queue.empty()) {
+                return;  // stopping
+            }
+            job = std::move(tp->queue.front());
+            tp->queue.pop_front();
+        }
+        job.work();
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(tp->mu);
+            wake = tp->finished.empty();  // otherwise the loop has a wake-up pending already
+            tp->finished.push_back(std::move(job));
+        }
+        if (wake) {
+            uint64_t one = 1;
+            ssize_t rv = write(tp->efd, &one, sizeof(one));
+            (void)rv;  // can only fail if the counter overflows, and then it is readable anyway
+        }
+    }
+}
+
+// Returns -1 if the eventfd can't be created
+inline int thread_pool_init(ThreadPool &tp, size_t nthreads) {
+    tp.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (tp.efd < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < nthreads; i++) {
+        tp.threads.emplace_back(thread_pool_worker, &tp);
+    }
+    return 0;
+}
+
+inline void thread_pool_submit(ThreadPool &tp, std::function<void()> work,
+                               std::function<void()> done) {
+    {
+        std::lock_guard<std::mutex> lock(tp.mu);
+        tp.queue.push_back(PoolJob{std::move(work), std::move(done)});
+    }
+    tp.cv.notify_one();
+}
+
+// Run the done() callbacks of finished jobs. Returns how many ran.
+inline size_t thread_pool_complete(ThreadPool &tp) {
+    uint64_t count = 0;
+    ssize_t rv = read(tp.efd, &count, sizeof(count));
+    (void)rv;
+    std::vector<PoolJob> finished;
+    {
+        std::lock_guard<std::mutex> lock(tp.mu);
+        finished.swap(tp.finished);
+    }
+    for (PoolJob &job : finished) {
+        job.done();
+    }
+    return finished.size();
+}
+
+// Fork-join use of a pool whose eventfd is not polled: run fn on up to helpers workers and on
+// the calling thread at once, and return when every call has returned
+inline void thread_pool_run(ThreadPool &tp, size_t helpers, const std::function<void()> &fn) {
+    helpers = std::min(helpers, tp.threads.size());
+    std::mutex mu;
+    std::condition_variable cv;
+    size_t running = helpers;
+    for (size_t i = 0; i < helpers; i++) {
+        thread_pool_submit(
+            tp,
+            [&] {
+                fn();
+                std::lock_guard<std::mutex> lock(mu);
+                if (--running == 0) {
+                    cv.notify_one();
+                }
+            },
+            [] {});
+    }
+    fn();
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&] { return running == 0; });
+    lock.unlock();
+    thread_pool_complete(tp);  // drop the empty done() callbacks finished so far
+}
+
+// Finish the queued work, join the workers and drop the done() callbacks that never ran
+inline void thread_pool_destroy(ThreadPool &tp) {
+    {
+        std::lock_guard<std::mutex> lock(tp.mu);
+        tp.stop = true;
+    }
+    tp.cv.notify_all();
+    for (std::thread &t : tp.threads) {
+        t.join();
+    }
+    tp.threads.clear();
+    tp.finished.clear();
+    if (tp.efd >= 0) {
+        close(tp.efd);
+        tp.efd = -1;
+    }
+}
+
+#endif  // THREAD_POOL_HPP_
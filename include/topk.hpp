@@ -0,0 +1,164 @@
+#ifndef TOPK_HPP_
+#define TOPK_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+constexpr size_t kSketchDepth = 4;
+constexpr size_t kSketchWidth = 2048;  // power of 2
+constexpr size_t kTopK = 32;
+constexpr size_t kMaxTrackedKeyLen = 256;  // longer keys are reported truncated
+
+// 64-bit FNV-1a with the murmur3 finalizer; the sketch derives all its row hashes from this
+inline uint64_t sketch_hash(const uint8_t *data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Count-min sketch with conservative update: only the rows holding the current minimum are
+// incremented, which keeps the over-estimate of cold keys much lower than a plain update.
+//
+//            +----+----+----+-----+----+
+//   row 0    |    | h0 |    | ... |    |
+//   row 1    | h1 |    |    | ... |    |
+//   ...                    estimate = min over the rows
+//            +----+----+----+-----+----+
+struct CountMinSketch {
+    uint32_t counters[kSketchDepth][kSketchWidth] = {};
+
+    // Kirsch-Mitzenmacher: row i uses h1 + i * h2, so one 64-bit hash serves every row
+    uint32_t add(uint64_t hash) {
+        uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+        uint32_t *cells[kSketchDepth];
+        uint32_t min = UINT32_MAX;
+        for (size_t i = 0; i < kSketchDepth; i++) {
+            cells[i] = &counters[i][(h1 + i * h2) & (kSketchWidth - 1)];
+            min = std::min(min, *cells[i]);
+        }
+        if (min == UINT32_MAX) {
+            return min;
+        }
+        for (size_t i = 0; i < kSketchDepth; i++) {
+            if (*cells[i] == min) {
+                (*cells[i])++;
+            }
+        }
+        return min + 1;
+    }
+
+    // Scale every counter by factor / 65536
+    void decay(uint32_t factor) {
+        for (size_t i = 0; i < kSketchDepth; i++) {
+            for (size_t j = 0; j < kSketchWidth; j++) {
+                counters[i][j] = (uint32_t)(((uint64_t)counters[i][j] * factor) >> 16);
+            }
+        }
+    }
+};
+
+// Heavy hitters on top of the sketch: a min-heap holding the kTopK keys with the largest
+// estimates. A key enters the heap once its estimate beats the current minimum. Memory is fixed
+// (the sketch plus kTopK truncated keys) no matter how many distinct keys pass through.
+struct TopK {
+    struct Item {
+        uint32_t count;
+        uint64_t hash;
+        std::string key;
+    };
+
+    CountMinSketch sketch;
+    std::vector<Item> heap;  // min-heap on count
+
+    void add(const uint8_t *key, size_t len) {
+        uint64_t hash = sketch_hash(key, len);
+        uint32_t count = sketch.add(hash);
+
+        for (size_t i = 0; i < heap.size(); i++) {
+            if (heap[i].hash == hash) {
+                heap[i].count = count;
+                sift_down(i);  // the count only grows
+                return;
+            }
+        }
+        if (heap.size() < kTopK) {
+            heap.push_back(Item{count, hash, make_key(key, len)});
+            sift_up(heap.size() - 1);
+        } else if (count > heap[0].count) {
+            heap[0] = Item{count, hash, make_key(key, len)};
+            sift_down(0);
+        }
+    }
+
+    void decay(uint32_t factor) {
+        sketch.decay(factor);
+        // Uniform scaling keeps the heap order, except for ties that don't matter
+        for (Item &item : heap) {
+            item.count = (uint32_t)(((uint64_t)item.count * factor) >> 16);
+        }
+    }
+
+    // The n hottest keys, hottest first
+    std::vector<std::pair<std::string, uint32_t>> top(size_t n) const {
+        std::vector<std::pair<std::string, uint32_t>> out;
+        for (const Item &item : heap) {
+            if (item.count > 0) {
+                out.emplace_back(item.key, item.count);
+            }
+        }
+        std::sort(out.begin(), out.end(),
+                  [](const auto &a, const auto &b) { return a.second > b.second; });
+        if (out.size() > n) {
+            out.resize(n);
+        }
+        return out;
+    }
+
+   private:
+    static std::string make_key(const uint8_t *key, size_t len) {
+        return std::string(reinterpret_cast<const char *>(key), std::min(len, kMaxTrackedKeyLen));
+    }
+
+    void sift_up(size_t pos) {
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if (heap[parent].count <= heap[pos].count) {
+                break;
+            }
+            std::swap(heap[parent], heap[pos]);
+            pos = parent;
+        }
+    }
+
+    void sift_down(size_t pos) {
+        while (true) {
+            size_t l = pos * 2 + 1, r = l + 1, min = pos;
+            if (l < heap.size() && heap[l].count < heap[min].count) {
+                min = l;
+            }
+            if (r < heap.size() && heap[r].count < heap[min].count) {
+                min = r;
+            }
+            if (min == pos) {
+                return;
+            }
+            std::swap(heap[min], heap[pos]);
+            pos = min;
+        }
+    }
+};
+
+#endif  // TOPK_HPP_
@@ -0,0 +1,50 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+// Static tracepoints (USDT, SystemTap SDT style) in the "cachex" provider. Each probe compiles
+// to a single nop plus a note in the ELF file; the arguments are only read when a tracer such as
+// bpftrace or perf attaches. Without <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel) the
+// probes come from sdt_probe.hpp instead; with -DCACHEX_NO_TRACE, or off ELF, the macros expand
+// to nothing.
+//
+// Probes, in the order a request passes them (timings come from the tracer's own timestamps):
+//   request_start(fd, frame_len)                 a complete frame is buffered
+//   request_parsed(fd, op, command, key_len)     command is a const char *, e.g. "GET"
+//   request_done(fd, op, status, reply_len)      reply appended to the outgoing buffer
+//   conn_flush(fd, bytes_sent, bytes_left)       after each send() of the outgoing buffer
+// scripts/cacheX_latency.bt turns them into per-phase latency histograms.
+
+#if !defined(CACHEX_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CACHEX_HAVE_USDT 1
+#elif defined(__ELF__) && defined(__GNUC__)
+#include "sdt_probe.hpp"
+#define CACHEX_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef CACHEX_HAVE_USDT
+#define CACHEX_TRACE2(name, a, b) DTRACE_PROBE2(cachex, name, a, b)
+#define CACHEX_TRACE3(name, a, b, c) DTRACE_PROBE3(cachex, name, a, b, c)
+#define CACHEX_TRACE4(name, a, b, c, d) DTRACE_PROBE4(cachex, name, a, b, c, d)
+#else
+// sizeof() keeps the arguments referenced without evaluating them
+#define CACHEX_TRACE2(name, a, b) \
+    do {                          \
+        (void)sizeof(a);          \
+        (void)sizeof(b);          \
+    } while (0)
+#define CACHEX_TRACE3(name, a, b, c) \
+    do {                             \
+        CACHEX_TRACE2(name, a, b);   \
+        (void)sizeof(c);             \
+    } while (0)
+#define CACHEX_TRACE4(name, a, b, c, d) \
+    do {                                \
+        CACHEX_TRACE3(name, a, b, c);   \
+        (void)sizeof(d);                \
+    } while (0)
+#endif
+
+#endif  // TRACE_HPP_
@@ -0,0 +1,357 @@
+#include "cacheX_async.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+
+constexpr size_t kAsyncMaxEvents = 64;
+
+struct AsyncRequest {
+    uint32_t id;  // matched against the reply in v2; v1 replies only have their order
+    CacheXCallback cb;
+    size_t quiet;  // quiet requests queued just before this one; its reply shows they were run
+};
+
+struct AsyncConn {
+    int fd = -1;
+    uint32_t proto = kProtoV1;
+    uint32_t next_id = 1;  // 0 would match frames that carry no ID
+    bool want_write = false;  // EPOLLOUT is registered: wbuf holds bytes not yet sent
+    std::vector<uint8_t> wbuf;
+    size_t woff = 0;  // bytes of wbuf already sent
+    std::vector<uint8_t> rbuf;
+    std::deque<AsyncRequest> inflight;  // in request order
+    size_t quiet = 0;  // quiet requests queued after the last entry of inflight
+};
+
+struct CacheXAsync {
+    int epfd = -1;
+    std::vector<AsyncConn> conns;
+    size_t pending = 0;  // requests not known to be done, quiet ones included
+    size_t quiet = 0;    // sum of the connections' quiet: no reply will tell when they are done
+};
+
+static void conn_update_events(CacheXAsync *client, size_t idx, bool want_write) {
+    AsyncConn &conn = client->conns[idx];
+    if (conn.want_write == want_write) {
+        return;
+    }
+    struct epoll_event event = {};
+    event.events = want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.u64 = idx;
+    epoll_ctl(client->epfd, EPOLL_CTL_MOD, conn.fd, &event);
+    conn.want_write = want_write;
+}
+
+// Drop a broken connection and fail everything that was waiting on it
+static int conn_fail(CacheXAsync *client, size_t idx) {
+    AsyncConn &conn = client->conns[idx];
+    epoll_ctl(client->epfd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    cacheX_close(conn.fd);
+    conn.fd = -1;
+    conn.wbuf.clear();
+    conn.woff = 0;
+    conn.rbuf.clear();
+
+    std::deque<AsyncRequest> failed;
+    failed.swap(conn.inflight);
+    client->pending -= failed.size() + conn.quiet;
+    client->quiet -= conn.quiet;
+    conn.quiet = 0;
+    for (const AsyncRequest &req : failed) {
+        client->pending -= req.quiet;
+    }
+    for (AsyncRequest &req : failed) {
+        req.cb(-1, std::string());
+    }
+    return (int)failed.size();
+}
+
+static int conn_flush(CacheXAsync *client, size_t idx) {
+    AsyncConn &conn = client->conns[idx];
+    while (conn.woff < conn.wbuf.size()) {
+        ssize_t bytes = send(conn.fd, conn.wbuf.data() + conn.woff, conn.wbuf.size() - conn.woff,
+                             MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            conn_update_events(client, idx, true);
+            return 0;
+        }
+        if (bytes < 0) {
+            fprintf(stderr, "Device %d: send() error: %s\n", conn.fd, strerror(errno));
+            return conn_fail(client, idx);
+        }
+        conn.woff += (size_t)bytes;
+    }
+    conn.wbuf.clear();
+    conn.woff = 0;
+    conn_update_events(client, idx, false);
+    return 0;
+}
+
+// Read everything available and run the callback of every complete reply
+static int conn_read(CacheXAsync *client, size_t idx) {
+    AsyncConn &conn = client->conns[idx];
+    uint8_t buf[64 * 1024];
+    while (true) {
+        ssize_t bytes = recv(conn.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (bytes <= 0) {
+            fprintf(stderr, "Device %d: %s\n", conn.fd, bytes == 0 ? "EOF" : "recv() error");
+            return conn_fail(client, idx);
+        }
+        buffer_append(conn.rbuf, buf, (size_t)bytes);
+        if ((size_t)bytes < sizeof(buf)) {
+            break;
+        }
+    }
+
+    int ncalls = 0;
+    size_t pos = 0;
+    while (conn.rbuf.size() - pos >= kHeaderSize) {
+        uint32_t len = 0;
+        memcpy(&len, &conn.rbuf[pos], kHeaderSize);
+        if (len < kV2ReplyHeader || len > kMaxPayloadSize) {
+            fprintf(stderr, "Device %d: malformed reply.\n", conn.fd);
+            return ncalls + conn_fail(client, idx);  // the stream can't be resynchronized
+        }
+        if (conn.rbuf.size() - pos < kHeaderSize + len) {
+            break;  // incomplete reply
+        }
+        const uint8_t *body = &conn.rbuf[pos + kHeaderSize];
+        pos += kHeaderSize + len;
+
+        Response reply;
+        V2Header hdr;
+        if (conn.proto == kProtoV2) {
+            if (parse_reply_v2(body, len, hdr, reply) < 0) {
+                fprintf(stderr, "Device %d: malformed reply.\n", conn.fd);
+                return ncalls + conn_fail(client, idx);
+            }
+        } else if (len >= kHeaderSize) {
+            memcpy(&reply.status, body, kHeaderSize);
+            reply.data.assign(body + kHeaderSize, body + len);
+        } else {
+            fprintf(stderr, "Device %d: malformed reply.\n", conn.fd);
+            return ncalls + conn_fail(client, idx);
+        }
+
+        // Push messages answer no request, and this client asks for none
+        if (reply.status == RES_PUSH) {
+            continue;
+        }
+        // Quiet requests have no entry; a reply with an unknown ID is one of them failing
+        auto it = conn.inflight.begin();
+        if (conn.proto == kProtoV2) {
+            while (it != conn.inflight.end() && it->id != hdr.id) {
+                ++it;
+            }
+        }
+        if (it == conn.inflight.end()) {
+            fprintf(stderr, "Device %d: request %u failed with status %u.\n", conn.fd, hdr.id,
+                    reply.status);
+            continue;
+        }
+        CacheXCallback cb = std::move(it->cb);
+        client->pending -= 1 + it->quiet;
+        conn.inflight.erase(it);
+        cb((int)reply.status, std::string(reply.data.begin(), reply.data.end()));
+        ncalls++;
+    }
+    buffer_consume(conn.rbuf, pos);
+    return ncalls;
+}
+
+// Take the ID of the request being queued, skipping 0 when the counter wraps
+static uint32_t conn_next_id(AsyncConn &conn) {
+    uint32_t id = conn.next_id++;
+    if (conn.next_id == 0) {
+        conn.next_id = 1;
+    }
+    return id;
+}
+
+// Queue a request on a live connection. cmd[0] is the v1 command name. A quiet request gets no
+// callback and, on a v2 connection, no reply unless it fails; it stays pending until the reply
+// to a later request on the connection. The first request queued on an idle connection
+// registers EPOLLOUT, which a writable socket reports at once, so the epoll fd wakes a caller's
+// loop to flush it.
+static int submit_to(CacheXAsync *client, size_t idx, uint8_t op,
+                     const std::vector<std::string> &cmd, CacheXCallback cb, bool quiet = false) {
+    AsyncConn &conn = client->conns[idx];
+    conn_update_events(client, idx, true);
+    if (conn.proto == kProtoV1) {
+        if (encode_request(conn.wbuf, cmd) < 0) {
+            return -1;
+        }
+        if (quiet) {
+            cb = [](int, const std::string &) {};  // the reply still comes back
+        }
+    } else {
+        uint8_t flags = V2_FLAG_ID | (quiet ? V2_FLAG_QUIET : 0);
+        if (encode_request_v2(conn.wbuf, op, flags, conn.next_id, cmd) < 0) {
+            return -1;
+        }
+        if (quiet) {
+            conn_next_id(conn);
+            conn.quiet++;
+            client->quiet++;
+            client->pending++;
+            return 0;
+        }
+    }
+    conn.inflight.push_back(AsyncRequest{conn_next_id(conn), std::move(cb), conn.quiet});
+    client->quiet -= conn.quiet;
+    conn.quiet = 0;
+    client->pending++;
+    return 0;
+}
+
+// Commands on the same key always share a connection, so they complete in submission order
+static int submit(CacheXAsync *client, uint8_t op, const std::vector<std::string> &cmd,
+                  CacheXCallback cb, bool quiet = false) {
+    size_t n = client->conns.size();
+    size_t start = std::hash<std::string>{}(cmd[1]) % n;
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = (start + i) % n;
+        if (client->conns[idx].fd >= 0) {
+            return submit_to(client, idx, op, cmd, std::move(cb), quiet);
+        }
+    }
+    return -1;
+}
+
+CacheXAsync *cacheX_async_connect(const char *host, int port, int nconns) {
+    if (nconns <= 0) {
+        nconns = 1;
+    }
+
+    CacheXAsync *client = new CacheXAsync();
+    client->epfd = epoll_create1(EPOLL_CLOEXEC);
+    client->conns.resize(nconns);
+    bool any = false;
+    for (size_t i = 0; i < client->conns.size(); i++) {
+        int fd = cacheX_connect(host, port);
+        if (fd < 0) {
+            continue;
+        }
+        // Older servers reject HELLO and the connection simply stays on v1
+        if (cacheX_hello(fd, kProtoV2) == (int)kProtoV2) {
+            client->conns[i].proto = kProtoV2;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(client->epfd, EPOLL_CTL_ADD, fd, &event);
+        client->conns[i].fd = fd;
+        any = true;
+    }
+
+    if (!any) {
+        close(client->epfd);
+        delete client;
+        return nullptr;
+    }
+    return client;
+}
+
+int cacheX_async_set(CacheXAsync *client, const std::string &key, const std::string &value,
+                     CacheXCallback cb) {
+    return submit(client, OP_SET, {"SET", key, value}, std::move(cb));
+}
+
+int cacheX_async_set_quiet(CacheXAsync *client, const std::string &key, const std::string &value) {
+    return submit(client, OP_SET, {"SET", key, value}, nullptr, true);
+}
+
+int cacheX_async_get(CacheXAsync *client, const std::string &key, CacheXCallback cb) {
+    return submit(client, OP_GET, {"GET", key}, std::move(cb));
+}
+
+int cacheX_async_del(CacheXAsync *client, const std::string &key, CacheXCallback cb) {
+    return submit(client, OP_DEL, {"DEL", key}, std::move(cb));
+}
+
+int cacheX_async_poll(CacheXAsync *client, int timeout_ms) {
+    int ncalls = 0;
+    for (size_t i = 0; i < client->conns.size(); i++) {
+        if (client->conns[i].fd >= 0 && !client->conns[i].wbuf.empty()) {
+            ncalls += conn_flush(client, i);
+        }
+    }
+    if (client->pending == client->quiet) {
+        return ncalls;  // no reply is due
+    }
+
+    struct epoll_event events[kAsyncMaxEvents];
+    int nevents = epoll_wait(client->epfd, events, kAsyncMaxEvents, timeout_ms);
+    if (nevents < 0) {
+        return errno == EINTR ? ncalls : -1;
+    }
+    for (int i = 0; i < nevents; i++) {
+        size_t idx = events[i].data.u64;
+        if (client->conns[idx].fd < 0) {
+            continue;  // failed earlier in this batch
+        }
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            ncalls += conn_read(client, idx);
+        }
+        if (client->conns[idx].fd >= 0 && (events[i].events & EPOLLOUT)) {
+            ncalls += conn_flush(client, idx);
+        }
+    }
+    return ncalls;
+}
+
+int cacheX_async_wait(CacheXAsync *client) {
+    // The server runs a connection's requests in order, so a HELLO, which changes nothing,
+    // answers for the quiet requests queued before it
+    for (size_t i = 0; i < client->conns.size() && client->quiet > 0; i++) {
+        if (client->conns[i].quiet > 0) {
+            submit_to(client, i, OP_HELLO, {"HELLO"}, [](int, const std::string &) {});
+        }
+    }
+    while (client->pending > 0) {
+        if (cacheX_async_poll(client, -1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+size_t cacheX_async_pending(CacheXAsync *client) { return client->pending; }
+
+int cacheX_async_fd(CacheXAsync *client) { return client->epfd; }
+
+void cacheX_async_close(CacheXAsync *client) {
+    if (!client) {
+        return;
+    }
+    for (size_t i = 0; i < client->conns.size(); i++) {
+        if (client->conns[i].fd >= 0) {
+            conn_fail(client, i);
+        }
+    }
+    close(client->epfd);
+    delete client;
+}
@@ -3,10 +3,14 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <string>
@@ -26,6 +30,26 @@ int cacheX_connect(const char *host, int port) {
     // convert IPv4 and IPv6 addresses from text to binary form
     inet_pton(AF_INET, host, &server_addr.sin_addr);
 
+    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    // Requests are written in one send(); don't let Nagle hold back pipelined ones
+    int level = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &level, sizeof(level));
+    return sock;
+}
+
+int cacheX_connect_unix(const char *path) {
+    struct sockaddr_un server_addr = {};
+    if (strlen(path) >= sizeof(server_addr.sun_path)) return -1;
+    server_addr.sun_family = AF_UNIX;
+    strcpy(server_addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) return -1;
+
     if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
         close(sock);
         return -1;
@@ -67,6 +91,252 @@ std::string cacheX_get(int sock, const std::string &key) {
     return "";
 }
 
+// Send a command whose reply is an integer
+static int64_t int_command(int sock, const std::vector<std::string> &command) {
+    Response response;
+    int64_t val = 0;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK || response.data.size() != sizeof(val)) {
+        return -1;
+    }
+    memcpy(&val, response.data.data(), sizeof(val));
+    return val;
+}
+
+int cacheX_get_versioned(int sock, const std::string &key, std::string &value,
+                         uint64_t &version) {
+    Response response;
+    if (send_request(sock, {"GET", key, "WITHVER"}) < 0 || read_response(sock, response) < 0) {
+        return -1;
+    }
+    if (response.status == RES_NX) {
+        return 1;
+    }
+    std::vector<std::string> items;
+    if (response.status != RES_OK ||
+        parse_request(response.data.data(), response.data.size(), items) < 0 ||
+        items.size() != 2) {
+        return -1;
+    }
+    value.swap(items[0]);
+    version = strtoull(items[1].c_str(), nullptr, 10);
+    return 0;
+}
+
+int64_t cacheX_set_if(int sock, const std::string &key, const std::string &value,
+                      CacheXSetCond cond, uint64_t version) {
+    std::vector<std::string> command = {"SET", key, value};
+    if (cond == CACHEX_SET_NX) {
+        command.push_back("NX");
+    } else if (cond == CACHEX_SET_XX) {
+        command.push_back("XX");
+    } else {
+        command.push_back("IFVER");
+        command.push_back(std::to_string(version));
+    }
+
+    Response response;
+    int64_t val = 0;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0) {
+        return -1;
+    }
+    if (response.status == RES_COND) {
+        return 0;
+    }
+    if (response.status != RES_OK || response.data.size() != sizeof(val)) {
+        return -1;
+    }
+    memcpy(&val, response.data.data(), sizeof(val));
+    return val;
+}
+
+int cacheX_getset(int sock, const std::string &key, const std::string &value, std::string &old) {
+    Response response;
+    if (send_request(sock, {"GETSET", key, value}) < 0 || read_response(sock, response) < 0) {
+        return -1;
+    }
+    if (response.status == RES_NX) {
+        return 1;
+    }
+    if (response.status != RES_OK) {
+        return -1;
+    }
+    old.assign(response.data.begin(), response.data.end());
+    return 0;
+}
+
+int cacheX_hello(int sock, int version) {
+    return (int)int_command(sock, {"HELLO", std::to_string(version)});
+}
+
+int cacheX_hset(int sock, const std::string &key,
+                const std::vector<std::pair<std::string, std::string>> &fields) {
+    std::vector<std::string> command = {"HSET", key};
+    for (const auto &fv : fields) {
+        command.push_back(fv.first);
+        command.push_back(fv.second);
+    }
+    return (int)int_command(sock, command);
+}
+
+std::string cacheX_hget(int sock, const std::string &key, const std::string &field) {
+    Response response;
+    if (send_request(sock, {"HGET", key, field}) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return "";
+    }
+    return std::string(response.data.begin(), response.data.end());
+}
+
+int cacheX_hmget(int sock, const std::string &key, const std::vector<std::string> &fields,
+                 std::vector<std::string> &values, std::vector<bool> &found) {
+    std::vector<std::string> command = {"HMGET", key};
+    command.insert(command.end(), fields.begin(), fields.end());
+    Response response;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+    return parse_array(response.data.data(), response.data.size(), values, found);
+}
+
+int cacheX_hdel(int sock, const std::string &key, const std::vector<std::string> &fields) {
+    std::vector<std::string> command = {"HDEL", key};
+    command.insert(command.end(), fields.begin(), fields.end());
+    return (int)int_command(sock, command);
+}
+
+int cacheX_hgetall(int sock, const std::string &key,
+                   std::vector<std::pair<std::string, std::string>> &out) {
+    Response response;
+    if (send_request(sock, {"HGETALL", key}) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+    std::vector<std::string> items;
+    if (parse_request(response.data.data(), response.data.size(), items) < 0 ||
+        items.size() % 2 != 0) {
+        return -1;
+    }
+    out.clear();
+    for (size_t i = 0; i < items.size(); i += 2) {
+        out.emplace_back(items[i], items[i + 1]);
+    }
+    return 0;
+}
+
+int cacheX_pfadd(int sock, const std::string &key, const std::vector<std::string> &elements) {
+    std::vector<std::string> command = {"PFADD", key};
+    command.insert(command.end(), elements.begin(), elements.end());
+    return (int)int_command(sock, command);
+}
+
+int64_t cacheX_pfcount(int sock, const std::vector<std::string> &keys) {
+    std::vector<std::string> command = {"PFCOUNT"};
+    command.insert(command.end(), keys.begin(), keys.end());
+    return int_command(sock, command);
+}
+
+int cacheX_pfmerge(int sock, const std::string &dest, const std::vector<std::string> &sources) {
+    std::vector<std::string> command = {"PFMERGE", dest};
+    command.insert(command.end(), sources.begin(), sources.end());
+    Response response;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+int cacheX_hotkeys(int sock, bool writes, int count,
+                   std::vector<std::pair<std::string, uint64_t>> &out) {
+    std::vector<std::string> command = {"HOTKEYS", writes ? "WRITE" : "READ",
+                                        std::to_string(count)};
+    Response response;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+
+    std::vector<std::string> items;
+    if (parse_request(response.data.data(), response.data.size(), items) < 0 ||
+        items.size() % 2 != 0) {
+        return -1;
+    }
+    out.clear();
+    for (size_t i = 0; i < items.size(); i += 2) {
+        out.emplace_back(items[i], strtoull(items[i + 1].c_str(), nullptr, 10));
+    }
+    return 0;
+}
+
+int64_t cacheX_bulkload(int sock, const std::string &path) {
+    return int_command(sock, {"BULKLOAD", path});
+}
+
+int64_t cacheX_unlink(int sock, const std::vector<std::string> &keys) {
+    std::vector<std::string> command = {"UNLINK"};
+    command.insert(command.end(), keys.begin(), keys.end());
+    return int_command(sock, command);
+}
+
+int cacheX_flushall(int sock, bool async) {
+    std::vector<std::string> command = {"FLUSHALL"};
+    if (async) {
+        command.push_back("ASYNC");
+    }
+    Response response;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+int64_t cacheX_publish(int sock, const std::string &channel, const std::string &message) {
+    return int_command(sock, {"PUBLISH", channel, message});
+}
+
+static int keys_command(int sock, const std::vector<std::string> &command,
+                        std::vector<std::string> &keys) {
+    Response response;
+    if (send_request(sock, command) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+    keys.clear();
+    return parse_request(response.data.data(), response.data.size(), keys) < 0 ? -1 : 0;
+}
+
+int cacheX_keyrange(int sock, const std::string &start, const std::string &end, uint64_t limit,
+                    std::vector<std::string> &keys) {
+    return keys_command(sock, {"KEYRANGE", start, end, "LIMIT", std::to_string(limit)}, keys);
+}
+
+int cacheX_keyprefix(int sock, const std::string &prefix, uint64_t limit,
+                     std::vector<std::string> &keys) {
+    return keys_command(sock, {"KEYPREFIX", prefix, "LIMIT", std::to_string(limit)}, keys);
+}
+
+int cacheX_info(int sock, std::vector<std::pair<std::string, std::string>> &out) {
+    Response response;
+    if (send_request(sock, {"INFO"}) < 0 || read_response(sock, response) < 0 ||
+        response.status != RES_OK) {
+        return -1;
+    }
+
+    std::vector<std::string> items;
+    if (parse_request(response.data.data(), response.data.size(), items) < 0 ||
+        items.size() % 2 != 0) {
+        return -1;
+    }
+    out.clear();
+    for (size_t i = 0; i < items.size(); i += 2) {
+        out.emplace_back(items[i], items[i + 1]);
+    }
+    return 0;
+}
+
 void cacheX_close(int sock) {
     shutdown(sock, SHUT_RDWR);
     close(sock);
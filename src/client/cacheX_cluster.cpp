@@ -0,0 +1,369 @@
+#include "cacheX_cluster.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+
+// Points per node on the ring. More points give a more even key spread at the cost of a larger
+// ring to search; 160 keeps the per-node load within a few percent of the mean.
+constexpr size_t kVirtualNodes = 160;
+// How long a node that failed to connect is skipped before it is tried again
+constexpr int64_t kNodeRetryMs = 1000;
+
+struct ClusterNode {
+    std::string host;
+    int port = 0;
+    int sock = -1;
+    int64_t retry_at_ms = 0;  // while sock < 0, the earliest time to try reconnecting
+};
+
+struct CacheXCluster {
+    std::vector<ClusterNode> nodes;
+    std::vector<std::pair<uint32_t, uint32_t>> ring;  // (point, node index), sorted by point
+};
+
+static int64_t now_ms() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a followed by the murmur3 finalizer. The finalizer matters here: virtual node names only
+// differ in their last few characters and plain FNV leaves them clustered on the ring.
+static uint32_t ring_hash(const std::string &s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : s) {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (uint32_t)(h >> 32);
+}
+
+// Returns true if the node has a live connection, reconnecting when its back-off has expired
+static bool node_usable(ClusterNode &node) {
+    if (node.sock >= 0) {
+        return true;
+    }
+    int64_t now = now_ms();
+    if (now < node.retry_at_ms) {
+        return false;
+    }
+    node.sock = cacheX_connect(node.host.c_str(), node.port);
+    if (node.sock < 0) {
+        node.retry_at_ms = now + kNodeRetryMs;
+        return false;
+    }
+    return true;
+}
+
+static void node_fail(ClusterNode &node) {
+    if (node.sock >= 0) {
+        cacheX_close(node.sock);
+        node.sock = -1;
+    }
+    node.retry_at_ms = now_ms() + kNodeRetryMs;
+}
+
+// Walk the ring clockwise from the key's point and return the first reachable node, so the keys
+// of a dead node fail over to its successor while every other key stays where it was.
+static int pick_node(CacheXCluster *cluster, const std::string &key) {
+    const auto &ring = cluster->ring;
+    if (ring.empty()) {
+        return -1;
+    }
+    std::pair<uint32_t, uint32_t> probe(ring_hash(key), 0);
+    size_t start = std::lower_bound(ring.begin(), ring.end(), probe) - ring.begin();
+    for (size_t i = 0; i < ring.size(); i++) {
+        uint32_t idx = ring[(start + i) % ring.size()].second;
+        if (node_usable(cluster->nodes[idx])) {
+            return (int)idx;
+        }
+    }
+    return -1;
+}
+
+static bool roundtrip(int sock, const std::vector<std::string> &cmd, Response &out) {
+    return send_request(sock, cmd) == 0 && read_response(sock, out) == 0;
+}
+
+// Send cmd to the owner of key and wait for the reply. A broken connection is reopened once, in
+// case the server restarted; if the node is still unreachable it is marked down and the request
+// moves on to the next node on the ring.
+static int cluster_call(CacheXCluster *cluster, const std::string &key,
+                        const std::vector<std::string> &cmd, Response &out) {
+    for (size_t attempt = 0; attempt < cluster->nodes.size(); attempt++) {
+        int idx = pick_node(cluster, key);
+        if (idx < 0) {
+            return -1;
+        }
+        ClusterNode &node = cluster->nodes[idx];
+        if (roundtrip(node.sock, cmd, out)) {
+            return 0;
+        }
+        cacheX_close(node.sock);
+        node.sock = cacheX_connect(node.host.c_str(), node.port);
+        if (node.sock >= 0 && roundtrip(node.sock, cmd, out)) {
+            return 0;
+        }
+        node_fail(node);
+    }
+    return -1;
+}
+
+// One node's share of a batch in flight: requests not yet written and replies not yet parsed
+struct BatchStream {
+    std::vector<size_t> items;  // indexes into the batch, in request order
+    std::vector<uint8_t> wbuf;
+    size_t written = 0;
+    std::vector<uint8_t> rbuf;
+    size_t replied = 0;  // items whose reply has been parsed
+};
+
+// Move complete reply frames from rbuf into out. Returns false on a malformed frame.
+static bool batch_parse(BatchStream &stream, std::vector<Response> &out) {
+    size_t pos = 0;
+    while (stream.rbuf.size() - pos >= 2 * kHeaderSize && stream.replied < stream.items.size()) {
+        uint32_t len = 0, status = 0;
+        memcpy(&len, &stream.rbuf[pos], kHeaderSize);
+        if (len < kHeaderSize || len > kMaxPayloadSize) {
+            return false;
+        }
+        if (stream.rbuf.size() - pos < kHeaderSize + len) {
+            break;
+        }
+        memcpy(&status, &stream.rbuf[pos + kHeaderSize], kHeaderSize);
+        Response &resp = out[stream.items[stream.replied++]];
+        resp.status = status;
+        resp.data.assign(stream.rbuf.begin() + pos + 2 * kHeaderSize,
+                         stream.rbuf.begin() + pos + kHeaderSize + len);
+        pos += kHeaderSize + len;
+    }
+    buffer_consume(stream.rbuf, pos);
+    return true;
+}
+
+// Send and receive on one node's connection without blocking. Returns false if it failed.
+static bool batch_io(int sock, short revents, BatchStream &stream, std::vector<Response> &out) {
+    if (revents & POLLNVAL) {
+        return false;
+    }
+    if ((revents & POLLOUT) && stream.written < stream.wbuf.size()) {
+        ssize_t n = send(sock, stream.wbuf.data() + stream.written,
+                         stream.wbuf.size() - stream.written, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return false;
+        }
+        stream.written += n > 0 ? (size_t)n : 0;
+    }
+    if (revents & (POLLIN | POLLERR | POLLHUP)) {
+        uint8_t buf[64 * 1024];
+        ssize_t n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            return false;
+        }
+        if (n > 0) {
+            buffer_append(stream.rbuf, buf, (size_t)n);
+            return batch_parse(stream, out);
+        }
+    }
+    return true;
+}
+
+// Route every command by its key (cmd[1]) and pipeline each node's share. Requests are written
+// while replies are read, on every node at once: a server stops reading a connection whose
+// unread replies pass its --output-limit, so writing a large batch whole before reading would
+// deadlock. Items on a node that fails mid-batch are retried one at a time through
+// cluster_call() so they fail over like single-key commands.
+static int cluster_batch(CacheXCluster *cluster, const std::vector<std::vector<std::string>> &cmds,
+                         std::vector<Response> &out) {
+    out.assign(cmds.size(), Response{});
+    std::vector<BatchStream> streams(cluster->nodes.size());
+    std::vector<size_t> retry;
+    for (size_t i = 0; i < cmds.size(); i++) {
+        int idx = pick_node(cluster, cmds[i][1]);
+        if (idx < 0) {
+            return -1;
+        }
+        streams[idx].items.push_back(i);
+        if (encode_request(streams[idx].wbuf, cmds[i]) < 0) {
+            return -1;
+        }
+    }
+
+    while (true) {
+        std::vector<struct pollfd> fds;
+        std::vector<size_t> nodes;
+        for (size_t n = 0; n < streams.size(); n++) {
+            BatchStream &stream = streams[n];
+            if (stream.replied == stream.items.size()) {
+                continue;
+            }
+            short events = POLLIN;
+            if (stream.written < stream.wbuf.size()) {
+                events |= POLLOUT;
+            }
+            fds.push_back({cluster->nodes[n].sock, events, 0});
+            nodes.push_back(n);
+        }
+        if (fds.empty()) {
+            break;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (size_t k = 0; k < fds.size(); k++) {
+            BatchStream &stream = streams[nodes[k]];
+            if (!batch_io(fds[k].fd, fds[k].revents, stream, out)) {
+                node_fail(cluster->nodes[nodes[k]]);
+                retry.insert(retry.end(), stream.items.begin() + stream.replied,
+                             stream.items.end());
+                stream.replied = stream.items.size();
+            }
+        }
+    }
+
+    for (size_t i : retry) {
+        if (cluster_call(cluster, cmds[i][1], cmds[i], out[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+CacheXCluster *cacheX_cluster_connect(const std::vector<std::string> &nodes) {
+    if (nodes.empty()) {
+        return nullptr;
+    }
+
+    CacheXCluster *cluster = new CacheXCluster();
+    for (const std::string &addr : nodes) {
+        size_t colon = addr.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == addr.size()) {
+            fprintf(stderr, "[ERROR] Invalid node address '%s', expected host:port.\n",
+                    addr.c_str());
+            delete cluster;
+            return nullptr;
+        }
+        ClusterNode node;
+        node.host = addr.substr(0, colon);
+        node.port = atoi(addr.c_str() + colon + 1);
+        cluster->nodes.push_back(node);
+    }
+
+    // Virtual node points are derived from the address, so every client builds the same ring
+    for (uint32_t idx = 0; idx < cluster->nodes.size(); idx++) {
+        for (size_t v = 0; v < kVirtualNodes; v++) {
+            std::string point = nodes[idx] + "#" + std::to_string(v);
+            cluster->ring.emplace_back(ring_hash(point), idx);
+        }
+    }
+    std::sort(cluster->ring.begin(), cluster->ring.end());
+
+    for (ClusterNode &node : cluster->nodes) {
+        node_usable(node);
+    }
+    return cluster;
+}
+
+int cacheX_cluster_set(CacheXCluster *cluster, const std::string &key, const std::string &value) {
+    Response resp;
+    if (cluster_call(cluster, key, {"SET", key, value}, resp) < 0 || resp.status != RES_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+std::string cacheX_cluster_get(CacheXCluster *cluster, const std::string &key) {
+    Response resp;
+    if (cluster_call(cluster, key, {"GET", key}, resp) < 0 || resp.status != RES_OK) {
+        return "";
+    }
+    return std::string(resp.data.begin(), resp.data.end());
+}
+
+int cacheX_cluster_del(CacheXCluster *cluster, const std::string &key) {
+    Response resp;
+    if (cluster_call(cluster, key, {"DEL", key}, resp) < 0 || resp.status != RES_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+int cacheX_cluster_mset(CacheXCluster *cluster,
+                        const std::vector<std::pair<std::string, std::string>> &kvs) {
+    std::vector<std::vector<std::string>> cmds;
+    cmds.reserve(kvs.size());
+    for (const auto &kv : kvs) {
+        cmds.push_back({"SET", kv.first, kv.second});
+    }
+
+    std::vector<Response> replies;
+    if (cluster_batch(cluster, cmds, replies) < 0) {
+        return -1;
+    }
+    for (const Response &resp : replies) {
+        if (resp.status != RES_OK) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int cacheX_cluster_mget(CacheXCluster *cluster, const std::vector<std::string> &keys,
+                        std::vector<std::string> &values) {
+    std::vector<std::vector<std::string>> cmds;
+    cmds.reserve(keys.size());
+    for (const std::string &key : keys) {
+        cmds.push_back({"GET", key});
+    }
+
+    std::vector<Response> replies;
+    if (cluster_batch(cluster, cmds, replies) < 0) {
+        return -1;
+    }
+    values.clear();
+    for (const Response &resp : replies) {
+        if (resp.status == RES_OK) {
+            values.emplace_back(resp.data.begin(), resp.data.end());
+        } else {
+            values.emplace_back();
+        }
+    }
+    return 0;
+}
+
+int cacheX_cluster_node_for(CacheXCluster *cluster, const std::string &key) {
+    return pick_node(cluster, key);
+}
+
+void cacheX_cluster_close(CacheXCluster *cluster) {
+    if (!cluster) {
+        return;
+    }
+    for (ClusterNode &node : cluster->nodes) {
+        if (node.sock >= 0) {
+            cacheX_close(node.sock);
+        }
+    }
+    delete cluster;
+}
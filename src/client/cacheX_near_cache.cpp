@@ -0,0 +1,210 @@
+#include "cacheX_near_cache.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cacheX_protocol.hpp"
+
+struct CacheXNearCache {
+    int sock = -1;
+    size_t capacity = 0;
+    std::vector<std::string> prefixes;
+    // Most recently used at the front
+    std::list<std::pair<std::string, std::string>> lru;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index;
+    std::vector<uint8_t> rbuf;  // received bytes not yet parsed into frames
+    CacheXNearCacheStats stats;
+};
+
+static void cache_erase(CacheXNearCache *cache, const std::string &key) {
+    auto it = cache->index.find(key);
+    if (it != cache->index.end()) {
+        cache->lru.erase(it->second);
+        cache->index.erase(it);
+    }
+}
+
+static void cache_insert(CacheXNearCache *cache, const std::string &key, const std::string &value) {
+    if (cache->capacity == 0) {
+        return;
+    }
+    cache_erase(cache, key);
+    cache->lru.emplace_front(key, value);
+    cache->index[key] = cache->lru.begin();
+    if (cache->lru.size() > cache->capacity) {
+        cache->index.erase(cache->lru.back().first);
+        cache->lru.pop_back();
+    }
+}
+
+// In prefix mode the server only reports keys under the prefixes, so nothing else may be cached
+static bool cacheable(CacheXNearCache *cache, const std::string &key) {
+    if (cache->prefixes.empty()) {
+        return true;
+    }
+    for (const std::string &prefix : cache->prefixes) {
+        if (key.compare(0, prefix.size(), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Pop one complete frame off the receive buffer
+static bool take_frame(CacheXNearCache *cache, Response &out) {
+    if (cache->rbuf.size() < kHeaderSize * 2) {
+        return false;
+    }
+    uint32_t len = 0;
+    memcpy(&len, cache->rbuf.data(), kHeaderSize);
+    if (cache->rbuf.size() < kHeaderSize + len) {
+        return false;
+    }
+    memcpy(&out.status, cache->rbuf.data() + kHeaderSize, kHeaderSize);
+    out.data.assign(cache->rbuf.begin() + kHeaderSize * 2, cache->rbuf.begin() + kHeaderSize + len);
+    buffer_consume(cache->rbuf, kHeaderSize + len);
+    return true;
+}
+
+// Returns bytes read, 0 if nothing was pending (non-blocking only), or -1 on error/EOF
+static int fill(CacheXNearCache *cache, bool block) {
+    uint8_t buf[64 * 1024];
+    while (true) {
+        ssize_t bytes = recv(cache->sock, buf, sizeof(buf), block ? 0 : MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0 && !block && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        if (bytes <= 0) {
+            return -1;
+        }
+        buffer_append(cache->rbuf, buf, (size_t)bytes);
+        return (int)bytes;
+    }
+}
+
+static void apply_push(CacheXNearCache *cache, const Response &push) {
+    std::vector<std::string> items;
+    if (parse_request(push.data.data(), push.data.size(), items) < 0 || items.empty() ||
+        items[0] != "invalidate") {
+        return;
+    }
+    cache->stats.invalidations++;
+    if (items.size() == 1) {  // the server dropped its tracking state
+        cache->lru.clear();
+        cache->index.clear();
+        return;
+    }
+    for (size_t i = 1; i < items.size(); i++) {
+        cache_erase(cache, items[i]);
+    }
+}
+
+// Apply every invalidation that has already arrived. No request is outstanding here, so every
+// complete frame must be a push.
+static int drain_pushes(CacheXNearCache *cache) {
+    int rv;
+    while ((rv = fill(cache, false)) > 0) {
+    }
+    Response frame;
+    while (take_frame(cache, frame)) {
+        apply_push(cache, frame);
+    }
+    return rv;
+}
+
+// Send one command and wait for its reply, applying any invalidations that arrive first
+static int call(CacheXNearCache *cache, const std::vector<std::string> &cmd, Response &out) {
+    if (send_request(cache->sock, cmd) < 0) {
+        return -1;
+    }
+    while (true) {
+        while (!take_frame(cache, out)) {
+            if (fill(cache, true) < 0) {
+                return -1;
+            }
+        }
+        if (out.status != RES_PUSH) {
+            return 0;
+        }
+        apply_push(cache, out);
+    }
+}
+
+CacheXNearCache *cacheX_near_cache_new(int sock, size_t capacity,
+                                       const std::vector<std::string> &prefixes) {
+    CacheXNearCache *cache = new CacheXNearCache();
+    cache->sock = sock;
+    cache->capacity = capacity;
+    cache->prefixes = prefixes;
+
+    std::vector<std::string> cmd = {"TRACKING", "ON"};
+    for (const std::string &prefix : prefixes) {
+        cmd.push_back("PREFIX");
+        cmd.push_back(prefix);
+    }
+    Response resp;
+    if (call(cache, cmd, resp) < 0 || resp.status != RES_OK) {
+        delete cache;
+        return nullptr;
+    }
+    return cache;
+}
+
+std::string cacheX_near_get(CacheXNearCache *cache, const std::string &key) {
+    if (drain_pushes(cache) < 0) {
+        // The connection is gone, so invalidations can no longer be trusted
+        cache->lru.clear();
+        cache->index.clear();
+        return "";
+    }
+
+    auto it = cache->index.find(key);
+    if (it != cache->index.end()) {
+        cache->stats.hits++;
+        cache->lru.splice(cache->lru.begin(), cache->lru, it->second);
+        return it->second->second;
+    }
+
+    cache->stats.misses++;
+    Response resp;
+    if (call(cache, {"GET", key}, resp) < 0 || resp.status != RES_OK) {
+        return "";
+    }
+    std::string value(resp.data.begin(), resp.data.end());
+    if (cacheable(cache, key)) {
+        cache_insert(cache, key, value);
+    }
+    return value;
+}
+
+int cacheX_near_set(CacheXNearCache *cache, const std::string &key, const std::string &value) {
+    cache_erase(cache, key);
+    Response resp;
+    if (call(cache, {"SET", key, value}, resp) < 0 || resp.status != RES_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+int cacheX_near_del(CacheXNearCache *cache, const std::string &key) {
+    cache_erase(cache, key);
+    Response resp;
+    if (call(cache, {"DEL", key}, resp) < 0 || resp.status != RES_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+CacheXNearCacheStats cacheX_near_cache_stats(CacheXNearCache *cache) { return cache->stats; }
+
+void cacheX_near_cache_free(CacheXNearCache *cache) { delete cache; }
@@ -0,0 +1,95 @@
+#include "cacheX_pubsub.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "cacheX_protocol.hpp"
+
+struct CacheXSubscriber {
+    int sock = -1;
+    std::deque<CacheXMessage> pending;  // received while waiting for a reply
+};
+
+// Keep a ["message", channel, payload] push; any other push is ignored
+static void keep_message(CacheXSubscriber *sub, const Response &push) {
+    std::vector<std::string> items;
+    if (parse_request(push.data.data(), push.data.size(), items) < 0 || items.size() != 3 ||
+        items[0] != "message") {
+        return;
+    }
+    sub->pending.push_back(CacheXMessage{std::move(items[1]), std::move(items[2])});
+}
+
+// Send one command and read its integer reply, keeping the messages that arrive first
+static int call(CacheXSubscriber *sub, const std::vector<std::string> &cmd) {
+    if (send_request(sub->sock, cmd) < 0) {
+        return -1;
+    }
+    Response response;
+    while (true) {
+        if (read_response(sub->sock, response) < 0) {
+            return -1;
+        }
+        if (response.status != RES_PUSH) {
+            break;
+        }
+        keep_message(sub, response);
+    }
+    int64_t val = 0;
+    if (response.status != RES_OK || response.data.size() != sizeof(val)) {
+        return -1;
+    }
+    memcpy(&val, response.data.data(), sizeof(val));
+    return (int)val;
+}
+
+CacheXSubscriber *cacheX_subscriber_new(int sock) {
+    CacheXSubscriber *sub = new CacheXSubscriber();
+    sub->sock = sock;
+    return sub;
+}
+
+int cacheX_subscribe(CacheXSubscriber *sub, const std::vector<std::string> &channels) {
+    std::vector<std::string> cmd = {"SUBSCRIBE"};
+    cmd.insert(cmd.end(), channels.begin(), channels.end());
+    return call(sub, cmd);
+}
+
+int cacheX_unsubscribe(CacheXSubscriber *sub, const std::vector<std::string> &channels) {
+    std::vector<std::string> cmd = {"UNSUBSCRIBE"};
+    cmd.insert(cmd.end(), channels.begin(), channels.end());
+    return call(sub, cmd);
+}
+
+int cacheX_next_message(CacheXSubscriber *sub, CacheXMessage &msg, int timeout_ms) {
+    while (sub->pending.empty()) {
+        struct pollfd pfd = {sub->sock, POLLIN, 0};
+        int rv = poll(&pfd, 1, timeout_ms);
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rv <= 0) {
+            return rv;
+        }
+        // No request is outstanding, so every frame is a push
+        Response push;
+        if (read_response(sub->sock, push) < 0 || push.status != RES_PUSH) {
+            return -1;
+        }
+        keep_message(sub, push);
+    }
+    msg = std::move(sub->pending.front());
+    sub->pending.pop_front();
+    return 1;
+}
+
+void cacheX_subscriber_close(CacheXSubscriber *sub) {
+    close(sub->sock);
+    delete sub;
+}
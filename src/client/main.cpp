@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include <functional>
 #include <iostream>
 #include <sstream>
@@ -10,6 +12,10 @@ void print_usage() {
     std::cout << "\nAvailable commands:\n"
               << "  SET <key> <value>  - Store a value\n"
               << "  GET <key>          - Retrieve a value\n"
+              << "  HOTKEYS [READ|WRITE] [n] - Show the hottest keys\n"
+              << "  INFO               - Show server statistics\n"
+              << "  BULKLOAD <path>    - Load a file from cacheX_bulk_build (server-side path)\n"
+              << "  KEYPREFIX <prefix> [n] - List up to n keys starting with prefix, in order\n"
               << "  EXIT               - Close connection\n\n";
 }
 
@@ -42,8 +48,74 @@ void handle_get(int sock, std::istringstream &iss) {
     }
 }
 
-int main() {
-    int sock = cacheX_connect("127.0.0.1", 6379);
+// Usage: cacheX_cli [host [port]]
+//        cacheX_cli -s <unix socket path>
+void handle_hotkeys(int sock, std::istringstream &iss) {
+    std::string kind;
+    int count = 10;
+    iss >> kind >> count;
+
+    std::vector<std::pair<std::string, uint64_t>> keys;
+    if (cacheX_hotkeys(sock, kind == "WRITE", count, keys) < 0) {
+        std::cerr << "[ERROR] HOTKEYS request failed.\n";
+        return;
+    }
+    for (const auto &item : keys) {
+        std::cout << item.first << "\t" << item.second << " ops/s\n";
+    }
+}
+
+void handle_info(int sock, std::istringstream &) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    if (cacheX_info(sock, fields) < 0) {
+        std::cerr << "[ERROR] INFO request failed.\n";
+        return;
+    }
+    for (const auto &field : fields) {
+        std::cout << field.first << ": " << field.second << "\n";
+    }
+}
+
+void handle_bulkload(int sock, std::istringstream &iss) {
+    std::string path;
+    if (!(iss >> path)) {
+        std::cerr << "[ERROR] Invalid BULKLOAD format. Use: BULKLOAD <path>\n";
+        return;
+    }
+    int64_t loaded = cacheX_bulkload(sock, path);
+    if (loaded < 0) {
+        std::cerr << "[ERROR] BULKLOAD failed, see the server log.\n";
+    } else {
+        std::cout << "Loaded " << loaded << " keys\n";
+    }
+}
+
+void handle_keyprefix(int sock, std::istringstream &iss) {
+    std::string prefix;
+    uint64_t limit = 100;
+    if (!(iss >> prefix)) {
+        std::cerr << "[ERROR] Invalid KEYPREFIX format. Use: KEYPREFIX <prefix> [n]\n";
+        return;
+    }
+    iss >> limit;
+
+    std::vector<std::string> keys;
+    if (cacheX_keyprefix(sock, prefix, limit, keys) < 0) {
+        std::cerr << "[ERROR] KEYPREFIX failed; is the server running with --key-index?\n";
+        return;
+    }
+    for (const std::string &key : keys) {
+        std::cout << key << "\n";
+    }
+}
+
+int main(int argc, char **argv) {
+    int sock;
+    if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        sock = cacheX_connect_unix(argv[2]);
+    } else {
+        sock = cacheX_connect(argc > 1 ? argv[1] : "127.0.0.1", argc > 2 ? atoi(argv[2]) : 6379);
+    }
     if (sock == -1) {
         std::cerr << "[ERROR] Failed to connect to CacheX server.\n";
         return EXIT_FAILURE;
@@ -54,6 +126,10 @@ int main() {
     std::unordered_map<std::string, std::function<void(int, std::istringstream &)>> command_map = {
         {"SET", handle_set},
         {"GET", handle_get},
+        {"HOTKEYS", handle_hotkeys},
+        {"INFO", handle_info},
+        {"BULKLOAD", handle_bulkload},
+        {"KEYPREFIX", handle_keyprefix},
         {"HELP", [](int, std::istringstream &) { print_usage(); }},
         {"EXIT", [](int, std::istringstream &) { std::cout << "Exiting...\n"; }}};
 
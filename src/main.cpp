@@ -1,9 +1,143 @@
+#include <getopt.h>
+#include <stdlib.h>
+
 #include <iostream>
 
 #include "server.hpp"
 
-int main() {
+static void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  -p, --port <port>         TCP port to listen on (default " << PORT << ")\n"
+              << "  -s, --unix-socket <path>  Also listen on a Unix domain socket\n"
+              << "      --no-nodelay          Keep Nagle's algorithm on TCP connections\n"
+              << "      --busy-poll <usec>    SO_BUSY_POLL budget for TCP connections\n"
+              << "      --hotkey-sample <n>   Track 1 in n key accesses for HOTKEYS, 0 = off\n"
+              << "      --handoff <path>      Take over from the server on this control socket\n"
+              << "                            (sockets and data), then serve upgrades there\n"
+              << "      --cpu <n>             Pin the event loop to core n\n"
+              << "      --spin <usec>         Poll for up to usec before blocking in epoll_wait()\n"
+              << "      --spill <dir>         Move cold string values to a log in dir\n"
+              << "      --spill-mem <MB>      Memory for values before spilling (default 1024)\n"
+              << "      --io-threads <n>      Threads reading spilled values back (default 2)\n"
+              << "      --key-index           Keep keys ordered for KEYRANGE and KEYPREFIX\n"
+              << "      --keyspace-events     Publish every write to key on __keyspace__:<key>\n"
+              << "      --pubsub-limit <MB>   Output a subscriber may fall behind (default 32)\n"
+              << "      --turn-requests <n>   Requests served per client per turn (default 64)\n"
+              << "      --turn-bytes <KB>     Bytes read per client per turn (default 256)\n"
+              << "      --output-limit <MB>   Pending output that pauses a client (default 8)\n"
+              << "  -h, --help                Show this help\n";
+}
+
+enum LongOnlyOption {
+    OPT_NO_NODELAY = 256,
+    OPT_BUSY_POLL,
+    OPT_HOTKEY_SAMPLE,
+    OPT_HANDOFF,
+    OPT_CPU,
+    OPT_SPIN,
+    OPT_SPILL,
+    OPT_SPILL_MEM,
+    OPT_IO_THREADS,
+    OPT_KEY_INDEX,
+    OPT_KEYSPACE_EVENTS,
+    OPT_PUBSUB_LIMIT,
+    OPT_TURN_REQUESTS,
+    OPT_TURN_BYTES,
+    OPT_OUTPUT_LIMIT,
+};
+
+int main(int argc, char **argv) {
+    ServerOptions opts;
+
+    static const struct option long_options[] = {
+        {"port", required_argument, nullptr, 'p'},
+        {"unix-socket", required_argument, nullptr, 's'},
+        {"no-nodelay", no_argument, nullptr, OPT_NO_NODELAY},
+        {"busy-poll", required_argument, nullptr, OPT_BUSY_POLL},
+        {"hotkey-sample", required_argument, nullptr, OPT_HOTKEY_SAMPLE},
+        {"handoff", required_argument, nullptr, OPT_HANDOFF},
+        {"cpu", required_argument, nullptr, OPT_CPU},
+        {"spin", required_argument, nullptr, OPT_SPIN},
+        {"spill", required_argument, nullptr, OPT_SPILL},
+        {"spill-mem", required_argument, nullptr, OPT_SPILL_MEM},
+        {"io-threads", required_argument, nullptr, OPT_IO_THREADS},
+        {"key-index", no_argument, nullptr, OPT_KEY_INDEX},
+        {"keyspace-events", no_argument, nullptr, OPT_KEYSPACE_EVENTS},
+        {"pubsub-limit", required_argument, nullptr, OPT_PUBSUB_LIMIT},
+        {"turn-requests", required_argument, nullptr, OPT_TURN_REQUESTS},
+        {"turn-bytes", required_argument, nullptr, OPT_TURN_BYTES},
+        {"output-limit", required_argument, nullptr, OPT_OUTPUT_LIMIT},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:s:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'p':
+                opts.port = atoi(optarg);
+                break;
+            case 's':
+                opts.unix_path = optarg;
+                break;
+            case OPT_NO_NODELAY:
+                opts.tcp_nodelay = false;
+                break;
+            case OPT_BUSY_POLL:
+                opts.busy_poll_us = atoi(optarg);
+                break;
+            case OPT_HOTKEY_SAMPLE:
+                opts.hotkey_sample = strtoul(optarg, nullptr, 10);
+                break;
+            case OPT_HANDOFF:
+                opts.handoff_path = optarg;
+                break;
+            case OPT_CPU:
+                opts.cpu = atoi(optarg);
+                break;
+            case OPT_SPIN:
+                opts.spin_us = strtoul(optarg, nullptr, 10);
+                break;
+            case OPT_SPILL:
+                opts.spill_dir = optarg;
+                break;
+            case OPT_SPILL_MEM:
+                opts.spill_mem = strtoull(optarg, nullptr, 10) << 20;
+                break;
+            case OPT_IO_THREADS:
+                opts.io_threads = strtoul(optarg, nullptr, 10);
+                break;
+            case OPT_KEY_INDEX:
+                opts.key_index = true;
+                break;
+            case OPT_KEYSPACE_EVENTS:
+                opts.keyspace_events = true;
+                break;
+            case OPT_PUBSUB_LIMIT:
+                opts.pubsub_limit = strtoull(optarg, nullptr, 10) << 20;
+                break;
+            case OPT_TURN_REQUESTS:
+                opts.turn_requests = strtoul(optarg, nullptr, 10);
+                if (opts.turn_requests == 0) {
+                    opts.turn_requests = 1;
+                }
+                break;
+            case OPT_TURN_BYTES:
+                opts.turn_bytes = strtoull(optarg, nullptr, 10) << 10;
+                break;
+            case OPT_OUTPUT_LIMIT:
+                opts.output_limit = strtoull(optarg, nullptr, 10) << 20;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
     std::cout << "CacheX Server Starting..." << std::endl;
-    start_server();
+    start_server(opts);
     return 0;
 }
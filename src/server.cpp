@@ -4,23 +4,127 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <numeric>
 #include <string>
+#include <thread>
 
+#include "avl.hpp"
+#include "bulk_file.hpp"
 #include "cacheX_protocol.hpp"
 #include "common.hpp"
+#include "hash_object.hpp"
 #include "hashmap.hpp"
+#include "hyperloglog.hpp"
+#include "lazy_free.hpp"
+#include "list.hpp"
+#include "snapshot.hpp"
+#include "spill_log.hpp"
+#include "thread_pool.hpp"
+#include "topk.hpp"
+#include "trace.hpp"
+
+// Hot-key counts decay continuously (in 8 steps per half-life), so they follow the recent
+// request rate instead of all-time totals.
+constexpr uint64_t kHotKeyHalfLifeMs = 5000;
+constexpr uint64_t kHotKeyDecayStepMs = kHotKeyHalfLifeMs / 8;
+constexpr uint32_t kHotKeyDecayFactor = 60097;  // 2^(-1/8) in 16.16 fixed point
+// Past this many tracked keys every tracking client is told to drop its whole cache
+constexpr size_t kMaxTrackedKeys = 1000 * 1000;
+// Handoff: the dataset is streamed in writes of about this size, and clients that are still
+// owed replies get this long to collect them before the old process exits anyway
+constexpr size_t kHandoffChunk = 1024 * 1024;
+constexpr uint64_t kHandoffDrainMs = 5000;
+// Tiered storage: values shorter than kSpillMinValue always stay in memory, since spilling them
+// would free little next to the key and the bookkeeping left behind. One spill pass writes at
+// most kSpillBatch bytes, so a burst of writes is moved out over several loop iterations.
+constexpr size_t kSpillMinValue = 64;
+constexpr size_t kSpillBatch = 4 * 1024 * 1024;
+constexpr uint64_t kSpillCompactCheckMs = 100;
+constexpr uint64_t kSpillRetryMs = 1000;  // after a failed write to the log
+// Strings from this size up are freed on the lazy-free thread. It matches glibc's mmap
+// threshold: smaller blocks go back to the heap cheaply, larger ones are unmapped page by page.
+constexpr size_t kLazyFreeMinBytes = 128 * 1024;
+// Gather writes take at most this many buffers at once
+constexpr size_t kMaxWriteIov = 64;
+// KEYRANGE and KEYPREFIX reply with at most this many keys unless given a LIMIT
+constexpr uint64_t kKeyRangeDefaultLimit = 1000;
+
+// A tracker fed 1 in opts.hotkey_sample of its own accesses, so each count stands for that
+// many accesses no matter how reads and writes interleave
+struct HotKeys {
+    TopK topk;
+    uint32_t countdown = 1;  // accesses until the next sample
+};
 
 static struct {
     HMap db;
+    AVLNode *key_index = nullptr;  // every key of db in byte order, with --key-index
     std::vector<Conn *> fd2conn;
+    ServerOptions opts;
+    // hot-key tracking
+    HotKeys hot_reads;
+    HotKeys hot_writes;
+    uint64_t hot_decay_at_ms = 0;
+    // client-side caching
+    uint64_t next_conn_id = 0;
+    HMap tracked;                                      // key -> connections that read it
+    std::vector<std::pair<int, uint64_t>> bcast;       // (fd, id) of prefix-tracking connections
+    std::vector<std::pair<int, uint64_t>> write_queue;  // connections with pushed messages
+    std::vector<std::pair<int, uint64_t>> run_queue;    // connections with work left over
+    uint64_t sched_yields = 0;   // turns that ended with work left over
+    uint64_t output_pauses = 0;  // turns that stopped at --output-limit
+    // pub/sub
+    HMap channels;  // name -> subscribed connections
+    uint64_t published = 0;
+    uint64_t pubsub_disconnects = 0;  // subscribers dropped for exceeding --pubsub-limit
+    // event loop accounting, reported by INFO
+    struct {
+        uint64_t iterations = 0;
+        uint64_t events = 0;
+        uint64_t busy_us = 0;     // handling events
+        uint64_t spin_us = 0;     // polling with a zero timeout
+        uint64_t blocked_us = 0;  // asleep in epoll_wait()
+        uint64_t spin_hits = 0;   // spins that found work before the budget ran out
+        uint64_t spin_misses = 0;
+    } loop;
+    uint32_t spin_budget_us = 0;
+    uint64_t last_version = 0;  // versions are never reused, even across deletes
+    LazyFree lazy_free;         // frees large values off the event loop
+    ThreadPool bulk_pool;       // decodes BULKLOAD files along with the loop thread
+    // tiered storage (--spill)
+    struct {
+        std::vector<std::shared_ptr<SpillSegment>> segs;  // by id, null once dropped; 0 unused
+        uint32_t active = 0;                               // segment receiving new records
+        DList lru;  // resident spillable values, most recently used first
+        uint64_t resident_bytes = 0;
+        ThreadPool pool;
+        std::vector<std::pair<int, uint64_t>> ready;  // blocked connections whose value is back
+        bool compacting = false;
+        uint64_t compact_check_ms = 0;
+        uint64_t retry_ms = 0;  // no spilling before this time
+        uint64_t spilled_keys = 0;
+        uint64_t reads = 0;  // values read back from the log
+        uint64_t compactions = 0;
+    } tier;
 } g_data;
 
 struct LookupKey {
@@ -28,30 +132,220 @@ struct LookupKey {
     std::string key;
 };
 
+enum EntryType {
+    T_STR = 0,
+    T_HLL = 1,
+    T_HASH = 2,
+};
+
+struct Entry;
+
+// An entry's place in g_data.key_index, allocated only with --key-index
+struct IndexNode {
+    AVLNode node;
+    Entry *ent = nullptr;
+};
+
+// Tiered storage, allocated for a string the first time it is large enough to spill. A
+// spilled string has an empty str, and its value is spill_len bytes at spill_off in segment
+// spill_seg.
+struct TierNode {
+    DList lru;
+    Entry *ent = nullptr;
+    uint32_t spill_seg = 0;  // 0 = resident
+    uint32_t spill_len = 0;
+    uint64_t spill_off = 0;
+    struct SpillRead *loading = nullptr;  // read of the value in flight
+};
+
 struct Entry {
     struct HNode node;
     std::string key;
+    uint32_t type = T_STR;
+    uint64_t version = 0;  // CAS token: changes on every write
     std::string str;
+    // The value of the other types, allocated by entry_new() for the entry's type
+    union {
+        HyperLogLog *hll = nullptr;  // T_HLL
+        HashObject *hash;            // T_HASH
+    };
+    IndexNode *index = nullptr;
+    TierNode *tier = nullptr;
+};
+
+// A spilled value being read back for the connections waiting on it
+struct SpillRead {
+    std::shared_ptr<SpillSegment> seg;  // keeps the file open if compaction drops the segment
+    uint64_t off = 0;
+    std::string key;
+    std::string value;
+    int err = 0;
+    std::vector<std::pair<int, uint64_t>> waiters;  // (fd, conn id)
 };
 
-static Entry *entry_new() {
+static bool tier_enabled() { return !g_data.opts.spill_dir.empty(); }
+
+// Stop accounting for the entry's string value, resident or spilled, before it is replaced
+// or freed. A spilled record becomes dead space for compaction to reclaim.
+static void tier_forget(Entry *ent) {
+    TierNode *tn = ent->tier;
+    if (!tn) {
+        return;
+    }
+    if (dlist_linked(&tn->lru)) {
+        dlist_detach(&tn->lru);
+        g_data.tier.resident_bytes -= ent->str.size();
+    }
+    if (tn->spill_seg) {
+        g_data.tier.segs[tn->spill_seg]->live -= spill_record_size(ent->key.size(), tn->spill_len);
+        g_data.tier.spilled_keys--;
+        tn->spill_seg = 0;
+    }
+    tn->loading = nullptr;
+}
+
+static bool tier_spilled(Entry *ent) { return ent->tier && ent->tier->spill_seg; }
+
+// Put a resident string under the memory budget, as the most recently used value
+static void tier_track(Entry *ent) {
+    if (tier_enabled() && ent->type == T_STR && ent->str.size() >= kSpillMinValue) {
+        if (!ent->tier) {
+            ent->tier = new TierNode();
+            ent->tier->ent = ent;
+        }
+        dlist_insert_after(&g_data.tier.lru, &ent->tier->lru);
+        g_data.tier.resident_bytes += ent->str.size();
+    }
+}
+
+static void tier_touch(Entry *ent) {
+    if (ent->tier && dlist_linked(&ent->tier->lru)) {
+        dlist_detach(&ent->tier->lru);
+        dlist_insert_after(&g_data.tier.lru, &ent->tier->lru);
+    }
+}
+
+// Allocate the value for the type; strings live in the entry itself
+static void entry_set_type(Entry *ent, uint32_t type) {
+    ent->type = type;
+    if (type == T_HLL) {
+        ent->hll = new HyperLogLog();
+    } else if (type == T_HASH) {
+        ent->hash = new HashObject();
+    }
+}
+
+static Entry *entry_new(uint32_t type) {
     Entry *ent = new Entry();
+    entry_set_type(ent, type);
     return ent;
 }
 
-static void entry_del(Entry *ent) {
-    // if (ent->type == T_ZSET) {
-    //     zset_clear(&ent->zset);
-    // }
+// Give the entry a fresh version after a write
+static void entry_touch(Entry *ent) { ent->version = ++g_data.last_version; }
+
+static const std::string &index_key(AVLNode *node) {
+    return container_of(node, IndexNode, node)->ent->key;
+}
+
+static bool entry_key_less(AVLNode *a, AVLNode *b) { return index_key(a) < index_key(b); }
+
+static bool entry_key_below(AVLNode *node, const void *key) {
+    return index_key(node) < *static_cast<const std::string *>(key);
+}
+
+// Call once the entry is in db; entry_del() takes it out of the index again
+static void key_index_add(Entry *ent) {
+    if (g_data.opts.key_index) {
+        ent->index = new IndexNode();
+        ent->index->ent = ent;
+        avl_insert(&g_data.key_index, &ent->index->node, &entry_key_less);
+    }
+}
+
+// Free the value of a hash or HyperLogLog; the entry is left a string
+static void entry_free_value(Entry *ent) {
+    if (ent->type == T_HLL) {
+        delete ent->hll;
+    } else if (ent->type == T_HASH && ent->hash) {
+        hash_clear(*ent->hash);
+        delete ent->hash;
+    }
+    ent->hll = nullptr;
+    ent->type = T_STR;
+}
+
+// Free the entry's memory. Touches no server state, so it can run on the lazy-free thread.
+static void entry_free(Entry *ent) {
+    entry_free_value(ent);
+    delete ent->index;
+    delete ent->tier;
     delete ent;
 }
 
+// Whether freeing is slow enough to hand off: a string past the mmap threshold, or a hash in
+// table form, which has an allocation per field
+static bool entry_free_is_slow(Entry *ent) {
+    return (ent->type == T_STR && ent->str.capacity() >= kLazyFreeMinBytes) ||
+           (ent->type == T_HASH && !ent->hash->packed);
+}
+
+// For an entry already out of db: unlink it from the index and the spill tier here, and free
+// it here or on the lazy-free thread
+static void entry_del(Entry *ent) {
+    if (ent->index) {
+        avl_remove(&g_data.key_index, &ent->index->node);
+    }
+    tier_forget(ent);
+    if (entry_free_is_slow(ent)) {
+        lazy_free_submit(g_data.lazy_free, [ent] { entry_free(ent); });
+    } else {
+        entry_free(ent);
+    }
+}
+
+// Hand a replaced string value to the lazy-free thread if freeing it would be slow
+static void lazy_free_string(std::string &value) {
+    if (value.capacity() >= kLazyFreeMinBytes) {
+        std::string *old = new std::string();
+        old->swap(value);
+        lazy_free_submit(g_data.lazy_free, [old] { delete old; });
+    }
+}
+
 static bool entry_eq(HNode *node, HNode *key) {
     struct Entry *ent = container_of(node, struct Entry, node);
     struct LookupKey *keydata = container_of(key, struct LookupKey, node);
     return ent->key == keydata->key;
 }
 
+// Connections that read a key while tracking is on. Entries are one-shot: the first write to
+// the key sends the invalidations and drops the entry.
+struct TrackedKey {
+    struct HNode node;
+    std::string key;
+    std::vector<std::pair<int, uint64_t>> readers;  // (fd, conn id)
+};
+
+static bool tracked_eq(HNode *node, HNode *key) {
+    struct TrackedKey *tk = container_of(node, struct TrackedKey, node);
+    struct LookupKey *keydata = container_of(key, struct LookupKey, node);
+    return tk->key == keydata->key;
+}
+
+// Connections subscribed to a channel. The channel goes away with its last subscriber.
+struct Channel {
+    struct HNode node;
+    std::string name;
+    std::vector<std::pair<int, uint64_t>> subscribers;  // (fd, conn id)
+};
+
+static bool channel_eq(HNode *node, HNode *key) {
+    struct Channel *ch = container_of(node, struct Channel, node);
+    struct LookupKey *keydata = container_of(key, struct LookupKey, node);
+    return ch->name == keydata->key;
+}
+
 static void msg(int line_number, const char *format, ...) {
     va_list vargs;
     va_start(vargs, format);
@@ -71,64 +365,1646 @@ static void die(int line_number, const char *format, ...) {
     exit(1);
 }
 
-static int set_nonblocking(int sockfd) {
-    errno = 0;
-    int flags = fcntl(sockfd, F_GETFL, 0);  // get the flags
-    if (errno) {
-        die(__LINE__, "%s: fcntl(), errno: %d", __func__, errno);
+static uint64_t get_monotonic_ms() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t get_monotonic_us() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Feed one key access into a tracker, sampling 1 in opts.hotkey_sample accesses
+static void hotkey_track(HotKeys &tracker, const std::string &key) {
+    if (g_data.opts.hotkey_sample == 0 || --tracker.countdown > 0) {
+        return;
+    }
+    tracker.countdown = g_data.opts.hotkey_sample;
+    tracker.topk.add(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+}
+
+static void hotkey_decay(uint64_t now_ms) {
+    if (g_data.hot_decay_at_ms == 0) {
+        g_data.hot_decay_at_ms = now_ms + kHotKeyDecayStepMs;
+        return;
+    }
+    // After a long idle period everything has decayed to zero anyway; cap the catch-up work
+    for (int steps = 0; now_ms >= g_data.hot_decay_at_ms; steps++) {
+        if (steps < 128) {
+            g_data.hot_reads.topk.decay(kHotKeyDecayFactor);
+            g_data.hot_writes.topk.decay(kHotKeyDecayFactor);
+        }
+        g_data.hot_decay_at_ms += kHotKeyDecayStepMs;
+    }
+}
+
+// HOTKEYS [READ|WRITE] [count]: flattened (key, estimated ops/sec) pairs, hottest first
+static void do_hotkeys(std::vector<std::string> &cmd, Response &out) {
+    bool writes = false;
+    size_t count = 10;
+    for (size_t i = 1; i < cmd.size(); i++) {
+        if (cmd[i] == "READ" || cmd[i] == "WRITE") {
+            writes = cmd[i] == "WRITE";
+        } else {
+            count = strtoul(cmd[i].c_str(), nullptr, 10);
+        }
+    }
+
+    hotkey_decay(get_monotonic_ms());
+    // Under steady load a decayed counter settles at rate * half-life / ln(2)
+    double per_count = 0.6931 / (kHotKeyHalfLifeMs / 1000.0) * g_data.opts.hotkey_sample;
+    auto top = (writes ? g_data.hot_writes : g_data.hot_reads).topk.top(count);
+    out_arr(out, top.size() * 2);
+    for (const auto &item : top) {
+        out_arr_str(out, item.first);
+        out_arr_str(out, std::to_string((uint64_t)(item.second * per_count + 0.5)));
+    }
+}
+
+// The fd alone is not enough to find a connection later: it may have been closed and reused
+static Conn *conn_lookup(int fd, uint64_t id) {
+    if ((size_t)fd >= g_data.fd2conn.size()) {
+        return nullptr;
+    }
+    Conn *conn = g_data.fd2conn[fd];
+    return conn && conn->id == id ? conn : nullptr;
+}
+
+static bool conn_has_output(const Conn *conn) {
+    return !conn->shared.empty() || !conn->outgoing.empty();
+}
+
+static size_t conn_output_bytes(const Conn *conn) {
+    return conn->shared_bytes + conn->outgoing.size();
+}
+
+// Answer the first buffered request with RES_ERR instead of running it. Returns false when no
+// complete request is buffered.
+static bool conn_fail_request(Conn *conn) {
+    if (conn->incoming.size() < kHeaderSize) {
+        return false;
+    }
+    uint32_t len = 0;
+    memcpy(&len, conn->incoming.data(), kHeaderSize);
+    if (len == 0 || len > kMaxPayloadSize || conn->incoming.size() < kHeaderSize + len) {
+        return false;
+    }
+    Response response;
+    response.status = RES_ERR;
+    if (conn->proto == kProtoV1) {
+        create_response(response, conn->outgoing);
+    } else {
+        V2Header hdr;
+        std::vector<std::string> cmd;
+        if (parse_request_v2(&conn->incoming[kHeaderSize], len, hdr, cmd) < 0) {
+            return false;
+        }
+        create_response_v2(response, hdr.flags, hdr.id, conn->outgoing);
+    }
+    buffer_consume(conn->incoming, kHeaderSize + len);
+    return true;
+}
+
+static void conn_queue_flush(Conn *conn) {
+    if (!conn->flush_queued) {
+        conn->flush_queued = true;
+        g_data.write_queue.emplace_back(conn->fd, conn->id);
+    }
+}
+
+// Queue an out-of-band message for a connection other than the one being served. It is sent by
+// flush_pushes() once the current batch of events is done.
+static void conn_push(Conn *conn, const Response &push) {
+    if (conn->proto == kProtoV2) {
+        create_response_v2(push, 0, 0, conn->outgoing);
+    } else {
+        create_response(push, conn->outgoing);
+    }
+    conn_queue_flush(conn);
+}
+
+// Like conn_push(), for a frame queued on many connections. A subscriber that has more than
+// --pubsub-limit bytes pending is not keeping up; it is closed instead of buffering without
+// bound.
+static void conn_push_shared(Conn *conn, const std::shared_ptr<const std::vector<uint8_t>> &frame) {
+    if (conn->shared_bytes + conn->outgoing.size() + frame->size() > g_data.opts.pubsub_limit) {
+        msg(__LINE__, "%s: client %d exceeded the pub/sub output limit, closing", __func__,
+            conn->fd);
+        conn->want_close = true;
+        g_data.pubsub_disconnects++;
+        conn_queue_flush(conn);
+        return;
+    }
+    if (!conn->outgoing.empty()) {
+        // Whatever is in outgoing was queued first, so it goes first
+        conn->shared_bytes += conn->outgoing.size();
+        conn->shared.push_back(
+            std::make_shared<const std::vector<uint8_t>>(std::move(conn->outgoing)));
+        conn->outgoing.clear();
+    }
+    conn->shared.push_back(frame);
+    conn->shared_bytes += frame->size();
+    conn_queue_flush(conn);
+}
+
+// Send ["message", channel, payload] to every subscriber of channel. Returns the number of
+// subscribers reached.
+static size_t pubsub_publish(LookupKey &channel, const std::string &payload) {
+    g_data.published++;
+    HNode *node = g_data.channels.lookup(&channel.node, &channel_eq);
+    if (!node) {
+        return 0;
+    }
+    Channel *ch = container_of(node, Channel, node);
+    Response push;
+    push.status = RES_PUSH;
+    out_arr(push, 3);
+    out_arr_str(push, "message");
+    out_arr_str(push, ch->name);
+    out_arr_str(push, payload);
+
+    std::shared_ptr<const std::vector<uint8_t>> frames[2];  // v1 and v2, encoded on first use
+    size_t reached = 0;
+    for (const auto &sub : ch->subscribers) {
+        Conn *conn = conn_lookup(sub.first, sub.second);
+        if (!conn || conn->want_close) {
+            continue;
+        }
+        auto &frame = frames[conn->proto == kProtoV2];
+        if (!frame) {
+            auto buf = std::make_shared<std::vector<uint8_t>>();
+            if (conn->proto == kProtoV2) {
+                create_response_v2(push, 0, 0, *buf);
+            } else {
+                create_response(push, *buf);
+            }
+            frame = std::move(buf);
+        }
+        conn_push_shared(conn, frame);
+        reached++;
+    }
+    return reached;
+}
+
+// Keyspace events: with --keyspace-events, a write to key is published on __keyspace__:<key>
+// with the event name as the message. process_request() publishes for the commands that write
+// one key; UNLINK and HDEL, which may publish more than one event, do it themselves.
+static bool keyspace_wanted(uint8_t op) {
+    if (!g_data.opts.keyspace_events || g_data.channels.size() == 0) {
+        return false;
+    }
+    switch (op) {
+        case OP_SET:
+        case OP_GETSET:
+        case OP_DEL:
+        case OP_UNLINK:
+        case OP_PFADD:
+        case OP_PFMERGE:
+        case OP_HSET:
+        case OP_HDEL:
+            return true;
+    }
+    return false;
+}
+
+static const char *keyspace_event(uint8_t op) {
+    switch (op) {
+        case OP_DEL:
+            return "del";
+        case OP_PFADD:
+            return "pfadd";
+        case OP_PFMERGE:
+            return "pfmerge";
+        case OP_HSET:
+            return "hset";
+    }
+    return "set";
+}
+
+static void keyspace_notify(const std::string &key, const char *event) {
+    LookupKey channel;
+    channel.key = "__keyspace__:" + key;
+    channel.node.hcode = str_hash((uint8_t *)channel.key.data(), channel.key.size());
+    pubsub_publish(channel, event);
+}
+
+static void pubsub_subscribe(Conn *conn, const std::string &name) {
+    if (std::find(conn->channels.begin(), conn->channels.end(), name) != conn->channels.end()) {
+        return;
+    }
+    LookupKey key;
+    key.key = name;
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    Channel *ch = nullptr;
+    if (HNode *node = g_data.channels.lookup(&key.node, &channel_eq)) {
+        ch = container_of(node, Channel, node);
+    } else {
+        ch = new Channel();
+        ch->name.swap(key.key);
+        ch->node.hcode = key.node.hcode;
+        g_data.channels.insert(&ch->node);
+    }
+    ch->subscribers.emplace_back(conn->fd, conn->id);
+    conn->channels.push_back(name);
+}
+
+static void pubsub_unsubscribe(Conn *conn, const std::string &name) {
+    auto it = std::find(conn->channels.begin(), conn->channels.end(), name);
+    if (it == conn->channels.end()) {
+        return;
+    }
+    *it = conn->channels.back();
+    conn->channels.pop_back();
+
+    LookupKey key;
+    key.key = name;
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    HNode *node = g_data.channels.lookup(&key.node, &channel_eq);
+    if (!node) {
+        return;
+    }
+    Channel *ch = container_of(node, Channel, node);
+    auto &subs = ch->subscribers;
+    auto sub = std::find(subs.begin(), subs.end(), std::make_pair(conn->fd, conn->id));
+    if (sub != subs.end()) {
+        *sub = subs.back();
+        subs.pop_back();
+    }
+    if (subs.empty()) {
+        g_data.channels.hm_delete(&key.node, &channel_eq);
+        delete ch;
+    }
+}
+
+// SUBSCRIBE channel [channel ...]: number of channels the connection is now subscribed to.
+// Messages then arrive as ["message", channel, payload] pushes.
+static void do_subscribe(Conn *conn, std::vector<std::string> &cmd, Response &out) {
+    for (size_t i = 1; i < cmd.size(); i++) {
+        pubsub_subscribe(conn, cmd[i]);
+    }
+    out_int(out, (int64_t)conn->channels.size());
+}
+
+// UNSUBSCRIBE [channel ...]: leave the given channels, or all of them. Replies like SUBSCRIBE.
+static void do_unsubscribe(Conn *conn, std::vector<std::string> &cmd, Response &out) {
+    if (cmd.size() == 1) {
+        std::vector<std::string> all = conn->channels;
+        for (const std::string &name : all) {
+            pubsub_unsubscribe(conn, name);
+        }
+    }
+    for (size_t i = 1; i < cmd.size(); i++) {
+        pubsub_unsubscribe(conn, cmd[i]);
+    }
+    out_int(out, (int64_t)conn->channels.size());
+}
+
+// PUBLISH channel message: number of subscribers that were sent the message
+static void do_publish(std::vector<std::string> &cmd, Response &out) {
+    LookupKey channel;
+    channel.key.swap(cmd[1]);
+    channel.node.hcode = str_hash((uint8_t *)channel.key.data(), channel.key.size());
+    out_int(out, (int64_t)pubsub_publish(channel, cmd[2]));
+}
+
+// Push ["invalidate", key], or just ["invalidate"] to drop everything when key is null
+static void send_invalidation(Conn *conn, const std::string *key) {
+    Response push;
+    push.status = RES_PUSH;
+    out_arr(push, key ? 2 : 1);
+    out_arr_str(push, "invalidate");
+    if (key) {
+        out_arr_str(push, *key);
+    }
+    conn_push(conn, push);
+}
+
+static void tracking_reset() {
+    std::vector<HNode *> nodes;
+    g_data.tracked.foreach (
+        [](HNode *node, void *arg) {
+            ((std::vector<HNode *> *)arg)->push_back(node);
+            return true;
+        },
+        &nodes);
+    for (HNode *node : nodes) {
+        delete container_of(node, TrackedKey, node);
+    }
+    g_data.tracked.clear();
+    g_data.tracked = HMap{};
+
+    for (Conn *conn : g_data.fd2conn) {
+        if (conn && conn->tracking && conn->prefixes.empty()) {
+            send_invalidation(conn, nullptr);
+        }
+    }
+}
+
+static void tracking_remember(Conn *conn, const LookupKey &key) {
+    if (!conn->tracking || !conn->prefixes.empty()) {
+        return;
+    }
+
+    TrackedKey *tk = nullptr;
+    HNode *node = g_data.tracked.lookup(const_cast<HNode *>(&key.node), &tracked_eq);
+    if (node) {
+        tk = container_of(node, TrackedKey, node);
+    } else {
+        if (g_data.tracked.size() >= kMaxTrackedKeys) {
+            tracking_reset();
+        }
+        tk = new TrackedKey();
+        tk->key = key.key;
+        tk->node.hcode = key.node.hcode;
+        g_data.tracked.insert(&tk->node);
+    }
+
+    std::pair<int, uint64_t> reader(conn->fd, conn->id);
+    for (const auto &r : tk->readers) {
+        if (r == reader) {
+            return;
+        }
+    }
+    tk->readers.push_back(reader);
+}
+
+// Called for every write to a key
+static void tracking_invalidate(const LookupKey &key) {
+    if (g_data.tracked.size() > 0) {
+        HNode *node = g_data.tracked.hm_delete(const_cast<HNode *>(&key.node), &tracked_eq);
+        if (node) {
+            TrackedKey *tk = container_of(node, TrackedKey, node);
+            for (const auto &r : tk->readers) {
+                Conn *conn = conn_lookup(r.first, r.second);
+                if (conn && conn->tracking) {
+                    send_invalidation(conn, &key.key);
+                }
+            }
+            delete tk;
+        }
+    }
+
+    for (size_t i = 0; i < g_data.bcast.size();) {
+        Conn *conn = conn_lookup(g_data.bcast[i].first, g_data.bcast[i].second);
+        if (!conn || !conn->tracking || conn->prefixes.empty()) {
+            g_data.bcast[i] = g_data.bcast.back();  // gone or switched off
+            g_data.bcast.pop_back();
+            continue;
+        }
+        for (const std::string &prefix : conn->prefixes) {
+            if (key.key.compare(0, prefix.size(), prefix) == 0) {
+                send_invalidation(conn, &key.key);
+                break;
+            }
+        }
+        i++;
+    }
+}
+
+// TRACKING ON [PREFIX p ...] | TRACKING OFF
+static void do_tracking(Conn *conn, std::vector<std::string> &cmd, Response &out) {
+    if (cmd[1] == "OFF") {
+        conn->tracking = false;
+        conn->prefixes.clear();
+        return;
+    }
+    if (cmd[1] != "ON" || cmd.size() % 2 != 0) {
+        out.status = RES_ERR;
+        return;
+    }
+
+    std::vector<std::string> prefixes;
+    for (size_t i = 2; i < cmd.size(); i += 2) {
+        if (cmd[i] != "PREFIX") {
+            out.status = RES_ERR;
+            return;
+        }
+        prefixes.push_back(cmd[i + 1]);
+    }
+
+    bool was_bcast = conn->tracking && !conn->prefixes.empty();
+    conn->tracking = true;
+    conn->prefixes.swap(prefixes);
+    if (!conn->prefixes.empty() && !was_bcast) {
+        g_data.bcast.emplace_back(conn->fd, conn->id);
+    }
+}
+
+static void lookup_key_init(LookupKey &key, std::string &name) {
+    key.key.swap(name);
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+}
+
+static Entry *entry_lookup(LookupKey &key) {
+    HNode *node = g_data.db.lookup(&key.node, &entry_eq);
+    return node ? container_of(node, Entry, node) : nullptr;
+}
+
+static Entry *entry_insert(LookupKey &key, uint32_t type) {
+    Entry *ent = entry_new(type);
+    ent->key.swap(key.key);
+    ent->node.hcode = key.node.hcode;
+    entry_touch(ent);
+    g_data.db.insert(&ent->node);
+    key_index_add(ent);
+    key.key = ent->key;  // callers still need the name for tracking
+    return ent;
+}
+
+static void tier_fetch_done(const std::shared_ptr<SpillRead> &read) {
+    LookupKey key;
+    key.key = read->key;
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    Entry *ent = entry_lookup(key);
+    TierNode *tn = ent ? ent->tier : nullptr;
+    if (tn && tn->loading == read.get()) {
+        tn->loading = nullptr;
+    }
+    // Unless the value was overwritten, deleted or moved by compaction in the meantime, it is
+    // in use again: keep it in memory. Either way the waiters just rerun their request. When
+    // the read failed, the requests that waited for it fail instead, and the entry still points
+    // at its record, so the next request for the key reads it again.
+    if (tn && tn->spill_seg == read->seg->id && tn->spill_off == read->off) {
+        if (read->err) {
+            msg(__LINE__, "%s: reading %s back failed, errno: %d", __func__, read->key.c_str(),
+                read->err);
+            for (const auto &waiter : read->waiters) {
+                Conn *conn = conn_lookup(waiter.first, waiter.second);
+                if (conn) {
+                    conn_fail_request(conn);  // the request that started the wait
+                }
+            }
+        } else {
+            tier_forget(ent);
+            ent->str.swap(read->value);
+            tier_track(ent);
+            g_data.tier.reads++;
+        }
+    }
+    g_data.tier.ready.insert(g_data.tier.ready.end(), read->waiters.begin(),
+                             read->waiters.end());
+}
+
+// Read a spilled value back on the I/O threads, and resume conn once it is in memory.
+// Connections asking for the same value share one read.
+static void tier_fetch(Entry *ent, Conn *conn) {
+    TierNode *tn = ent->tier;
+    if (!tn->loading) {
+        auto read = std::make_shared<SpillRead>();
+        read->seg = g_data.tier.segs[tn->spill_seg];
+        read->off = tn->spill_off;
+        read->key = ent->key;
+        read->value.resize(tn->spill_len);
+        tn->loading = read.get();
+        thread_pool_submit(
+            g_data.tier.pool,
+            [read] {
+                if (spill_pread(read->seg->fd, &read->value[0], read->value.size(), read->off) <
+                    0) {
+                    read->err = errno;
+                }
+            },
+            [read] { tier_fetch_done(read); });
+    }
+    tn->loading->waiters.emplace_back(conn->fd, conn->id);
+}
+
+// Commands that need a string's value check here first. When it is on disk the read is
+// started and the caller parks the connection, leaving the request queued to run again.
+static bool tier_must_wait(Conn *conn, uint8_t op, const std::vector<std::string> &cmd) {
+    if (!tier_enabled() || (op != OP_GET && op != OP_GETSET) || cmd.size() < 2) {
+        return false;
+    }
+    LookupKey key;
+    key.key = cmd[1];
+    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    Entry *ent = entry_lookup(key);
+    if (!ent || !tier_spilled(ent)) {
+        return false;
+    }
+    tier_fetch(ent, conn);
+    return true;
+}
+
+// Tiered storage. String values over the spill_mem budget move to an append-only log, least
+// recently used first; the entry keeps its key and the value's location. A read of a spilled
+// value parks the connection while an I/O thread fetches it, and the value then stays in
+// memory as the most recently used one. Overwrites and deletes leave dead records behind,
+// which compaction reclaims one sealed segment at a time.
+static bool tier_new_segment() {
+    int fd = spill_create_file(g_data.opts.spill_dir);
+    if (fd < 0) {
+        msg(__LINE__, "%s: can't create a spill file in %s, errno: %d", __func__,
+            g_data.opts.spill_dir.c_str(), errno);
+        return false;
+    }
+    auto seg = std::make_shared<SpillSegment>();
+    seg->id = g_data.tier.segs.size();
+    seg->fd = fd;
+    g_data.tier.segs.push_back(seg);
+    g_data.tier.active = seg->id;
+    return true;
+}
+
+static void tier_init() {
+    g_data.tier.segs.push_back(nullptr);  // id 0 marks resident values
+    size_t nthreads = std::max(g_data.opts.io_threads, 1u);
+    if (!tier_new_segment() || thread_pool_init(g_data.tier.pool, nthreads) < 0) {
+        die(__LINE__, "%s: can't set up tiered storage in %s", __func__,
+            g_data.opts.spill_dir.c_str());
+    }
+    printf("Spilling values beyond %llu bytes to %s\n",
+           (unsigned long long)g_data.opts.spill_mem, g_data.opts.spill_dir.c_str());
+}
+
+// Move least recently used values to the log until the resident ones fit in spill_mem
+static void tier_spill(uint64_t now_ms) {
+    auto &tier = g_data.tier;
+    if (tier.resident_bytes <= g_data.opts.spill_mem || now_ms < tier.retry_ms) {
+        return;
+    }
+    SpillSegment *seg = tier.segs[tier.active].get();
+    std::vector<uint8_t> buf;
+    std::vector<Entry *> moved;
+    while (tier.resident_bytes > g_data.opts.spill_mem && buf.size() < kSpillBatch) {
+        Entry *ent = container_of(tier.lru.prev, TierNode, lru)->ent;
+        uint64_t start = seg->size + buf.size();
+        ent->tier->spill_off = start + spill_put_record(buf, ent->key, ent->str);
+        dlist_detach(&ent->tier->lru);
+        tier.resident_bytes -= ent->str.size();
+        moved.push_back(ent);
+    }
+    if (spill_pwrite(seg->fd, buf.data(), buf.size(), seg->size) < 0) {
+        msg(__LINE__, "%s: write to the spill log failed, errno: %d", __func__, errno);
+        for (Entry *ent : moved) {
+            tier_track(ent);
+        }
+        tier.retry_ms = now_ms + kSpillRetryMs;
+        return;
+    }
+    for (Entry *ent : moved) {
+        ent->tier->spill_seg = seg->id;
+        ent->tier->spill_len = ent->str.size();
+        seg->live += spill_record_size(ent->key.size(), ent->tier->spill_len);
+        std::string().swap(ent->str);  // release the memory, not just the contents
+        tier.spilled_keys++;
+    }
+    seg->size += buf.size();
+    if (seg->size >= g_data.opts.spill_segment) {
+        tier_new_segment();  // on failure the current segment just keeps growing
+    }
+}
+
+struct SpillCompaction {
+    std::shared_ptr<SpillSegment> from;
+    std::shared_ptr<SpillSegment> to;
+    std::vector<uint8_t> data;  // contents of from
+    struct Record {
+        std::string key;
+        uint64_t start;  // of the record in from
+        uint64_t size;
+        uint64_t old_off;  // of the value in from
+        uint64_t new_off;  // of the value in to
+    };
+    std::vector<Record> live;
+    int err = 0;
+};
+
+static void tier_compact_finish(const std::shared_ptr<SpillCompaction> &job) {
+    auto &tier = g_data.tier;
+    tier.compacting = false;
+    job->from->compacting = false;
+    if (job->err) {
+        msg(__LINE__, "%s: compacting spill segment %u failed, errno: %d", __func__,
+            job->from->id, job->err);
+        tier.segs[job->to->id].reset();
+        return;
+    }
+    // Records whose entry changed since the scan are dead on arrival in the new segment
+    for (const SpillCompaction::Record &rec : job->live) {
+        LookupKey key;
+        key.key = rec.key;
+        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+        Entry *ent = entry_lookup(key);
+        TierNode *tn = ent ? ent->tier : nullptr;
+        if (tn && tn->spill_seg == job->from->id && tn->spill_off == rec.old_off) {
+            tn->spill_seg = job->to->id;
+            tn->spill_off = rec.new_off;
+            job->from->live -= rec.size;
+            job->to->live += rec.size;
+        }
+    }
+    job->to->compacting = false;
+    tier.compactions++;
+    if (job->from->live == 0) {
+        tier.segs[job->from->id].reset();  // reads in flight still hold the file
+    }
+}
+
+// Runs on the loop once the segment has been read: keep the records that entries still point
+// to, and have a worker copy them into a new segment
+static void tier_compact_scan(const std::shared_ptr<SpillCompaction> &job) {
+    auto &tier = g_data.tier;
+    if (job->err) {
+        msg(__LINE__, "%s: reading spill segment %u failed, errno: %d", __func__,
+            job->from->id, job->err);
+        tier.compacting = false;
+        job->from->compacting = false;
+        return;
+    }
+    uint64_t pos = 0, out = 0;
+    std::string name;
+    size_t voff = 0;
+    uint32_t vlen = 0;
+    int64_t n = 0;
+    while ((n = spill_next(job->data.data() + pos, job->data.size() - pos, name, voff, vlen)) >
+           0) {
+        LookupKey key;
+        key.key.swap(name);
+        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+        Entry *ent = entry_lookup(key);
+        TierNode *tn = ent ? ent->tier : nullptr;
+        if (tn && tn->spill_seg == job->from->id && tn->spill_off == pos + voff) {
+            job->live.push_back(SpillCompaction::Record{std::move(key.key), pos, (uint64_t)n,
+                                                        pos + voff, out + voff});
+            out += (uint64_t)n;
+        }
+        pos += (uint64_t)n;
+    }
+
+    job->to = std::make_shared<SpillSegment>();
+    job->to->id = tier.segs.size();
+    job->to->size = out;
+    job->to->compacting = true;  // not eligible until it is filled in
+    tier.segs.push_back(job->to);
+    std::string dir = g_data.opts.spill_dir;
+    thread_pool_submit(
+        tier.pool,
+        [job, dir] {
+            std::vector<uint8_t> buf;
+            buf.reserve(job->to->size);
+            for (const SpillCompaction::Record &rec : job->live) {
+                buf.insert(buf.end(), job->data.begin() + rec.start,
+                           job->data.begin() + rec.start + rec.size);
+            }
+            job->to->fd = spill_create_file(dir);
+            if (job->to->fd < 0 || spill_pwrite(job->to->fd, buf.data(), buf.size(), 0) < 0) {
+                job->err = errno;
+            }
+        },
+        [job] { tier_compact_finish(job); });
+}
+
+// Drop segments nothing points to any more, and start compacting one that is mostly dead
+static void tier_compact() {
+    auto &tier = g_data.tier;
+    for (auto &seg : tier.segs) {
+        if (!seg || seg->id == tier.active || seg->compacting) {
+            continue;
+        }
+        if (seg->live == 0) {
+            seg.reset();
+        } else if (!tier.compacting && seg->live * 2 < seg->size) {
+            auto job = std::make_shared<SpillCompaction>();
+            job->from = seg;
+            seg->compacting = true;
+            tier.compacting = true;
+            thread_pool_submit(
+                tier.pool,
+                [job] {
+                    job->data.resize(job->from->size);
+                    if (spill_pread(job->from->fd, job->data.data(), job->data.size(), 0) < 0) {
+                        job->err = errno;
+                    }
+                },
+                [job] { tier_compact_scan(job); });
+        }
+    }
+}
+
+// Between loop iterations: enforce the memory budget, and now and then look for segments
+// to reclaim
+static void tier_maintain(uint64_t now_ms) {
+    tier_spill(now_ms);
+    if (now_ms >= g_data.tier.compact_check_ms) {
+        g_data.tier.compact_check_ms = now_ms + kSpillCompactCheckMs;
+        tier_compact();
+    }
+}
+
+// After FLUSHALL: nothing is resident or spilled any more. Every record on disk is dead, so
+// tier_compact() drops the segments.
+static void tier_reset() {
+    auto &tier = g_data.tier;
+    tier.lru.prev = tier.lru.next = &tier.lru;
+    tier.resident_bytes = 0;
+    tier.spilled_keys = 0;
+    for (auto &seg : tier.segs) {
+        if (seg) {
+            seg->live = 0;
+        }
+    }
+}
+
+// Whether the loop should come back without sleeping: a spill pass stopped at its batch limit
+static bool tier_behind() {
+    return tier_enabled() && g_data.tier.resident_bytes > g_data.opts.spill_mem &&
+           get_monotonic_ms() >= g_data.tier.retry_ms;
+}
+
+// Whether a record's value decodes. entry_from_record() accepts exactly these, so BULKLOAD can
+// check a whole file before it changes anything. Files come from anyone who can name one, so
+// a sketch must not index outside its registers either.
+static bool record_value_valid(uint8_t type, const uint8_t *value, size_t len) {
+    if (type == REC_HLL) {
+        if (len == 0) {
+            return false;
+        }
+        if (value[0]) {
+            return len == 1 + kHllDenseSize && hll_dense_valid(value + 1);
+        }
+        return (len - 1) % sizeof(uint32_t) == 0 &&
+               hll_sparse_valid(value + 1, (len - 1) / sizeof(uint32_t));
+    }
+    if (type == REC_HASH) {
+        // An array payload of field/value pairs, framed like a request
+        const uint8_t *end = value + len;
+        uint32_t n = 0;
+        if (!read_u32(value, end, n) || n > kMaxArgs || n % 2 != 0) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t slen = 0;
+            if (!read_u32(value, end, slen) || slen > (size_t)(end - value)) {
+                return false;
+            }
+            value += slen;
+        }
+        return value == end;
+    }
+    return type == REC_STR;
+}
+
+// Build an entry from a snapshot record without touching the keyspace, so any thread can do
+// it. Returns nullptr if the record is malformed.
+static Entry *entry_from_record(SnapshotRecord &rec) {
+    if (!record_value_valid(rec.type, (const uint8_t *)rec.value.data(), rec.value.size())) {
+        return nullptr;  // an unknown type, or a value that does not decode as its type
+    }
+    Entry *ent = entry_new(rec.type);
+    if (rec.type == REC_STR) {
+        ent->str.swap(rec.value);
+    } else if (rec.type == REC_HLL) {
+        const std::string &v = rec.value;
+        HyperLogLog &hll = *ent->hll;
+        hll.dense = v[0];
+        if (hll.dense) {
+            hll.regs.assign(v.begin() + 1, v.end());
+        } else {
+            hll.sparse.resize((v.size() - 1) / sizeof(uint32_t));
+            memcpy(hll.sparse.data(), v.data() + 1, v.size() - 1);
+        }
+    } else {
+        std::vector<std::string> pairs;
+        parse_request((const uint8_t *)rec.value.data(), rec.value.size(), pairs);
+        for (size_t i = 0; i < pairs.size(); i += 2) {
+            hash_set(*ent->hash, pairs[i], pairs[i + 1]);
+        }
+    }
+    ent->version = rec.version;
+    ent->key.swap(rec.key);
+    ent->node.hcode = str_hash((uint8_t *)ent->key.data(), ent->key.size());
+    return ent;
+}
+
+// GET key [WITHVER]: the value, or with WITHVER an array of (value, version)
+static void do_get(Conn *conn, std::vector<std::string> &cmd, Response &out) {
+    if (cmd.size() == 3 && cmd[2] != "WITHVER") {
+        out.status = RES_ERR;
+        return;
+    }
+    LookupKey key;
+    lookup_key_init(key, cmd[1]);
+    Entry *ent = entry_lookup(key);
+    if (!ent) {
+        out.status = RES_NX;
+        return;
+    }
+    if (ent->type != T_STR) {
+        out.status = RES_ERR;  // wrong type
+        return;
+    }
+    if (cmd.size() == 3) {
+        out_arr(out, 2);
+        out_arr_str(out, ent->str);
+        out_arr_str(out, std::to_string(ent->version));
+    } else {
+        out.data.assign(ent->str.begin(), ent->str.end());
+    }
+    tier_touch(ent);
+    tracking_remember(conn, key);
+}
+
+// Store a string under key, replacing a value of any type
+static Entry *set_string(LookupKey &key, Entry *ent, std::string &value) {
+    tracking_invalidate(key);
+    if (!ent) {
+        ent = entry_insert(key, T_STR);
+    } else if (ent->type != T_STR) {
+        if (ent->type == T_HASH && !ent->hash->packed) {
+            HashObject *old = ent->hash;
+            ent->hash = nullptr;
+            lazy_free_submit(g_data.lazy_free, [old] {
+                hash_clear(*old);
+                delete old;
+            });
+        }
+        entry_free_value(ent);
+    }
+    tier_forget(ent);
+    ent->str.swap(value);
+    lazy_free_string(value);  // now the old value
+    tier_track(ent);
+    entry_touch(ent);
+    return ent;
+}
+
+// SET key value [NX | XX] [IFVER version]
+// NX: only if the key does not exist. XX: only if it does. IFVER: only if its current version
+// matches. A conditional SET replies with the new version, or RES_COND without writing.
+static void do_set(std::vector<std::string> &cmd, Response &out) {
+    bool nx = false, xx = false, ifver = false;
+    uint64_t version = 0;
+    for (size_t i = 3; i < cmd.size(); i++) {
+        if (cmd[i] == "NX") {
+            nx = true;
+        } else if (cmd[i] == "XX") {
+            xx = true;
+        } else if (cmd[i] == "IFVER" && i + 1 < cmd.size()) {
+            char *end = nullptr;
+            version = strtoull(cmd[++i].c_str(), &end, 10);
+            ifver = *end == '\0' && !cmd[i].empty();
+            if (!ifver) {
+                out.status = RES_ERR;
+                return;
+            }
+        } else {
+            out.status = RES_ERR;
+            return;
+        }
+    }
+    if (nx && (xx || ifver)) {
+        out.status = RES_ERR;  // contradictory
+        return;
+    }
+
+    LookupKey key;
+    lookup_key_init(key, cmd[1]);
+    Entry *ent = entry_lookup(key);
+    if ((nx && ent) || ((xx || ifver) && !ent) || (ifver && ent->version != version)) {
+        out.status = RES_COND;
+        return;
+    }
+    ent = set_string(key, ent, cmd[2]);
+    if (nx || xx || ifver) {
+        out_int(out, (int64_t)ent->version);
+    }
+}
+
+// GETSET key value: store value and reply with the previous one (RES_NX if there was none)
+static void do_getset(std::vector<std::string> &cmd, Response &out) {
+    LookupKey key;
+    lookup_key_init(key, cmd[1]);
+    Entry *ent = entry_lookup(key);
+    if (ent && ent->type != T_STR) {
+        out.status = RES_ERR;
+        return;
+    }
+    if (ent) {
+        out.data.assign(ent->str.begin(), ent->str.end());
+    } else {
+        out.status = RES_NX;
+    }
+    set_string(key, ent, cmd[2]);
+}
+
+// PFADD key element [element ...]: 1 if the estimate may have changed, else 0. Returns whether
+// the sketch changed.
+static bool do_pfadd(std::vector<std::string> &cmd, Response &out) {
+    LookupKey key;
+    lookup_key_init(key, cmd[1]);
+    Entry *ent = entry_lookup(key);
+    bool changed = false;
+    if (!ent) {
+        ent = entry_insert(key, T_HLL);
+        changed = true;
+    } else if (ent->type != T_HLL) {
+        out.status = RES_ERR;
+        return false;
+    }
+
+    for (size_t i = 2; i < cmd.size(); i++) {
+        changed |= hll_add(*ent->hll, (const uint8_t *)cmd[i].data(), cmd[i].size());
+    }
+    if (changed) {
+        entry_touch(ent);
+        tracking_invalidate(key);
+    }
+    out_int(out, changed ? 1 : 0);
+    return changed;
+}
+
+// Max every source sketch into regs. Missing keys count as empty sketches.
+static bool hll_merge_keys(std::vector<std::string> &cmd, size_t first, uint8_t *regs) {
+    for (size_t i = first; i < cmd.size(); i++) {
+        LookupKey key;
+        lookup_key_init(key, cmd[i]);
+        Entry *ent = entry_lookup(key);
+        if (!ent) {
+            continue;
+        }
+        if (ent->type != T_HLL) {
+            return false;
+        }
+        hll_merge_into(regs, *ent->hll);
+    }
+    return true;
+}
+
+// PFCOUNT key [key ...]: estimated cardinality of the union
+static void do_pfcount(std::vector<std::string> &cmd, Response &out) {
+    if (cmd.size() == 2) {
+        LookupKey key;
+        lookup_key_init(key, cmd[1]);
+        Entry *ent = entry_lookup(key);
+        if (ent && ent->type != T_HLL) {
+            out.status = RES_ERR;
+            return;
+        }
+        out_int(out, ent ? (int64_t)hll_count(*ent->hll) : 0);
+        return;
+    }
+
+    std::vector<uint8_t> regs(kHllRegisters, 0);
+    if (!hll_merge_keys(cmd, 1, regs.data())) {
+        out.status = RES_ERR;
+        return;
+    }
+    out_int(out, (int64_t)hll_estimate(regs.data()));
+}
+
+// PFMERGE dest [source ...]: dest becomes the union of itself and the sources
+static void do_pfmerge(std::vector<std::string> &cmd, Response &out) {
+    std::vector<uint8_t> regs(kHllRegisters, 0);
+    std::string dest = cmd[1];
+    if (!hll_merge_keys(cmd, 1, regs.data())) {
+        out.status = RES_ERR;
+        return;
+    }
+
+    LookupKey key;
+    lookup_key_init(key, dest);
+    Entry *ent = entry_lookup(key);
+    if (!ent) {
+        ent = entry_insert(key, T_HLL);
+    }
+    hll_load(*ent->hll, regs.data());
+    entry_touch(ent);
+    tracking_invalidate(key);
+}
+
+// Look up a hash for reading. Returns false (with out.status set) on a type error; a missing
+// key leaves *ent null.
+static bool hash_lookup_for_read(std::string &name, Entry **ent, Response &out) {
+    LookupKey key;
+    lookup_key_init(key, name);
+    *ent = entry_lookup(key);
+    if (*ent && (*ent)->type != T_HASH) {
+        out.status = RES_ERR;
+        return false;
+    }
+    return true;
+}
+
+// HSET key field value [field value ...]: number of fields that were added
+static void do_hset(std::vector<std::string> &cmd, Response &out) {
+    if (cmd.size() % 2 != 0) {
+        out.status = RES_ERR;
+        return;
+    }
+    LookupKey key;
+    lookup_key_init(key, cmd[1]);
+    Entry *ent = entry_lookup(key);
+    if (!ent) {
+        ent = entry_insert(key, T_HASH);
+    } else if (ent->type != T_HASH) {
+        out.status = RES_ERR;
+        return;
+    }
+
+    int64_t added = 0;
+    for (size_t i = 2; i < cmd.size(); i += 2) {
+        added += hash_set(*ent->hash, cmd[i], cmd[i + 1]);
+    }
+    entry_touch(ent);
+    tracking_invalidate(key);
+    out_int(out, added);
+}
+
+// HGET key field
+static void do_hget(std::vector<std::string> &cmd, Response &out) {
+    Entry *ent = nullptr;
+    if (!hash_lookup_for_read(cmd[1], &ent, out)) {
+        return;
+    }
+    std::string value;
+    if (!ent || !hash_get(*ent->hash, cmd[2], value)) {
+        out.status = RES_NX;
+        return;
+    }
+    out.data.assign(value.begin(), value.end());
+}
+
+// HMGET key field [field ...]: array with a nil element for every missing field
+static void do_hmget(std::vector<std::string> &cmd, Response &out) {
+    Entry *ent = nullptr;
+    if (!hash_lookup_for_read(cmd[1], &ent, out)) {
+        return;
+    }
+    out_arr(out, cmd.size() - 2);
+    std::string value;
+    for (size_t i = 2; i < cmd.size(); i++) {
+        if (ent && hash_get(*ent->hash, cmd[i], value)) {
+            out_arr_str(out, value);
+        } else {
+            out_arr_nil(out);
+        }
+    }
+}
+
+// HDEL key field [field ...]: number of fields removed. The key goes away with its last field.
+static void do_hdel(std::vector<std::string> &cmd, Response &out) {
+    LookupKey key;
+    lookup_key_init(key, cmd[1]);
+    Entry *ent = entry_lookup(key);
+    if (ent && ent->type != T_HASH) {
+        out.status = RES_ERR;
+        return;
+    }
+
+    int64_t removed = 0;
+    for (size_t i = 2; ent && i < cmd.size(); i++) {
+        removed += hash_del(*ent->hash, cmd[i]);
+    }
+    if (removed > 0) {
+        bool notify = keyspace_wanted(OP_HDEL);
+        entry_touch(ent);
+        tracking_invalidate(key);
+        if (notify) {
+            keyspace_notify(key.key, "hdel");
+        }
+        if (hash_size(*ent->hash) == 0) {
+            g_data.db.hm_delete(&key.node, &entry_eq);
+            entry_del(ent);
+            if (notify) {
+                keyspace_notify(key.key, "del");
+            }
+        }
+    }
+    out_int(out, removed);
+}
+
+// HGETALL key: flattened field/value pairs
+static void do_hgetall(std::vector<std::string> &cmd, Response &out) {
+    Entry *ent = nullptr;
+    if (!hash_lookup_for_read(cmd[1], &ent, out)) {
+        return;
+    }
+    if (!ent) {
+        out_arr(out, 0);
+        return;
+    }
+    out_arr(out, hash_size(*ent->hash) * 2);
+    hash_foreach(*ent->hash, [&out](const std::string &field, const std::string &value) {
+        out_arr_str(out, field);
+        out_arr_str(out, value);
+    });
+}
+
+static bool entry_same_key(HNode *node, HNode *other) {
+    return container_of(node, Entry, node)->key == container_of(other, Entry, node)->key;
+}
+
+// Run fn(i) for every chunk index in [first, last) on the bulk pool and the loop thread. Stops
+// early once a call returns false; returns false if any did.
+template <typename F>
+static bool bulk_parallel(size_t first, size_t last, F fn) {
+    std::atomic<size_t> next{first};
+    std::atomic<bool> ok{true};
+    thread_pool_run(g_data.bulk_pool, last > first ? last - first - 1 : 0, [&] {
+        size_t i = 0;
+        while (ok && (i = next++) < last) {
+            if (!fn(i)) {
+                ok = false;
+            }
+        }
+    });
+    return ok;
+}
+
+// BULKLOAD path: load a bulk file (bulk_file.hpp, built by cacheX_bulk_build) from the server's
+// filesystem and reply with the number of records loaded. Later records replace earlier ones
+// and existing keys. A file is loaded whole or not at all: one pass checks every record first.
+// Then threads decode the records into finished entries a few chunks at a time, and the loop
+// links each batch into a table that was sized for the whole file up front. The loop serves
+// nothing else meanwhile.
+static void do_bulkload(std::vector<std::string> &cmd, Response &out) {
+    int fd = open(cmd[1].c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st = {};
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        msg(__LINE__, "%s: can't read %s, errno: %d", __func__, cmd[1].c_str(), errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        out.status = RES_ERR;
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    const uint8_t *data = static_cast<const uint8_t *>(map);
+    std::vector<BulkChunk> chunks;
+    uint64_t end = 0;
+    if (map == MAP_FAILED || bulk_read_index(data, size, chunks, end) < 0) {
+        msg(__LINE__, "%s: %s is not a bulk file", __func__, cmd[1].c_str());
+        if (map != MAP_FAILED) {
+            munmap(map, size);
+        }
+        out.status = RES_ERR;
+        return;
+    }
+    madvise(map, size, MADV_WILLNEED);
+    auto chunk_end = [&](size_t i) { return i + 1 < chunks.size() ? chunks[i + 1].offset : end; };
+
+    // Check the framing and every value first, so a truncated or corrupt file is rejected
+    // before any insert
+    size_t nthreads = g_data.bulk_pool.threads.size() + 1;
+    bool ok = bulk_parallel(0, chunks.size(), [&](size_t i) {
+        uint64_t pos = chunks[i].offset, stop = chunk_end(i), n = 0;
+        for (; pos < stop && n < chunks[i].nkeys; n++) {
+            int64_t len = snapshot_record_size(data + pos, stop - pos);
+            if (len <= 0 || data[pos] == REC_END) {
+                return false;
+            }
+            uint32_t klen = 0;
+            memcpy(&klen, data + pos + kRecordHeaderSize - 4, 4);
+            size_t value_at = kRecordHeaderSize + klen + 4;
+            if (!record_value_valid(data[pos], data + pos + value_at, (size_t)len - value_at)) {
+                return false;
+            }
+            pos += (uint64_t)len;
+        }
+        return pos == stop && n == chunks[i].nkeys;
+    });
+    uint64_t nkeys = 0;
+    for (const BulkChunk &chunk : chunks) {
+        nkeys += chunk.nkeys;
+    }
+    if (ok) {
+        g_data.db.reserve(nkeys);
+    }
+
+    uint64_t loaded = 0;
+    std::vector<std::vector<Entry *>> decoded;
+    for (size_t first = 0; ok && first < chunks.size(); first += nthreads) {
+        size_t last = std::min(first + nthreads, chunks.size());
+        decoded.assign(last - first, {});
+        ok = bulk_parallel(first, last, [&](size_t i) {
+            std::vector<Entry *> &ents = decoded[i - first];
+            ents.reserve(chunks[i].nkeys);
+            SnapshotRecord rec;
+            for (uint64_t pos = chunks[i].offset; pos < chunk_end(i);) {
+                pos += (uint64_t)snapshot_next(data + pos, chunk_end(i) - pos, rec);
+                Entry *ent = entry_from_record(rec);
+                if (!ent) {
+                    return false;  // a value that does not decode, like a bad HLL
+                }
+                ents.push_back(ent);
+            }
+            return true;
+        });
+        for (std::vector<Entry *> &ents : decoded) {
+            for (Entry *ent : ents) {
+                if (!ok) {
+                    entry_del(ent);
+                    continue;
+                }
+                HNode *old = g_data.db.hm_delete(&ent->node, &entry_same_key);
+                if (old) {
+                    LookupKey key;
+                    key.key = ent->key;
+                    key.node.hcode = ent->node.hcode;
+                    tracking_invalidate(key);
+                    entry_del(container_of(old, Entry, node));
+                }
+                entry_touch(ent);
+                g_data.db.insert(&ent->node);
+                key_index_add(ent);
+                tier_track(ent);
+                loaded++;
+            }
+        }
+        while (tier_behind()) {
+            tier_spill(get_monotonic_ms());
+        }
+    }
+    munmap(map, size);
+    if (!ok) {
+        msg(__LINE__, "%s: %s is malformed, loaded %llu records", __func__, cmd[1].c_str(),
+            (unsigned long long)loaded);
+        out.status = RES_ERR;
+        return;
+    }
+    out_int(out, (int64_t)loaded);
+}
+
+static int set_nonblocking(int sockfd) {
+    errno = 0;
+    int flags = fcntl(sockfd, F_GETFL, 0);  // get the flags
+    if (errno) {
+        die(__LINE__, "%s: fcntl(), errno: %d", __func__, errno);
+    }
+
+    int rv = fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);  // modify and set the flags
+    if (errno) {
+        die(__LINE__, "%s: fcntl(), errno: %d", __func__, errno);
+    }
+    return rv;
+}
+
+// Argument counts per opcode, including the command name; max 0 means no upper bound
+static const struct {
+    uint32_t min;
+    uint32_t max;
+} kArity[OP_MAX] = {
+    {0, 0},  // unused
+    {2, 3},  // GET key [WITHVER]
+    {3, 6},  // SET key value [NX|XX] [IFVER version]
+    {2, 2},  // DEL key
+    {2, 0},  // PFADD key element...
+    {2, 0},  // PFCOUNT key...
+    {2, 0},  // PFMERGE dest source...
+    {4, 0},  // HSET key field value...
+    {3, 3},  // HGET key field
+    {3, 0},  // HMGET key field...
+    {3, 0},  // HDEL key field...
+    {2, 2},  // HGETALL key
+    {2, 0},  // TRACKING ON|OFF ...
+    {1, 3},  // HOTKEYS [READ|WRITE] [count]
+    {1, 2},  // HELLO [version]
+    {1, 1},  // INFO
+    {3, 3},  // GETSET key value
+    {2, 2},  // BULKLOAD path
+    {3, 5},  // KEYRANGE start end [LIMIT n]
+    {2, 4},  // KEYPREFIX prefix [LIMIT n]
+    {2, 0},  // SUBSCRIBE channel...
+    {1, 0},  // UNSUBSCRIBE [channel...]
+    {3, 3},  // PUBLISH channel message
+    {2, 0},  // UNLINK key...
+    {1, 2},  // FLUSHALL [ASYNC]
+};
+
+// Remove a key if it exists. A large value is freed on the lazy-free thread by entry_del().
+static bool key_del(LookupKey &key) {
+    HNode *node = g_data.db.hm_delete(&key.node, &entry_eq);
+    if (!node) {
+        return false;
+    }
+    tracking_invalidate(key);
+    entry_del(container_of(node, Entry, node));
+    return true;
+}
+
+// UNLINK key [key ...]: number of keys removed
+static void do_unlink(std::vector<std::string> &cmd, Response &out) {
+    int64_t removed = 0;
+    bool notify = keyspace_wanted(OP_UNLINK);
+    for (size_t i = 1; i < cmd.size(); i++) {
+        LookupKey key;
+        lookup_key_init(key, cmd[i]);
+        if (key_del(key)) {
+            removed++;
+            if (notify) {
+                keyspace_notify(key.key, "del");
+            }
+        }
+    }
+    out_int(out, removed);
+}
+
+// Every entry of a keyspace that is no longer reachable from the server
+static void db_free(HMap &db) {
+    std::vector<HNode *> nodes;
+    nodes.reserve(db.size());
+    db.foreach (
+        [](HNode *node, void *arg) {
+            ((std::vector<HNode *> *)arg)->push_back(node);
+            return true;
+        },
+        &nodes);
+    for (HNode *node : nodes) {
+        entry_free(container_of(node, Entry, node));
+    }
+    db.clear();
+}
+
+// FLUSHALL [ASYNC]: drop every key. The keyspace is replaced by an empty one at once; with
+// ASYNC the old one is freed on the lazy-free thread, otherwise before the reply.
+static void do_flushall(std::vector<std::string> &cmd, Response &out) {
+    bool async = cmd.size() == 2;
+    if (async && cmd[1] != "ASYNC") {
+        out.status = RES_ERR;
+        return;
+    }
+    HMap old = g_data.db;
+    g_data.db = HMap{};
+    g_data.key_index = nullptr;
+    if (tier_enabled()) {
+        tier_reset();
+    }
+    // Tracking clients may hold any key: tell all of them to drop everything
+    tracking_reset();
+    for (const auto &item : g_data.bcast) {
+        Conn *conn = conn_lookup(item.first, item.second);
+        if (conn && conn->tracking && !conn->prefixes.empty()) {
+            send_invalidation(conn, nullptr);
+        }
+    }
+    if (async) {
+        lazy_free_submit(g_data.lazy_free, [old]() mutable { db_free(old); });
+    } else {
+        db_free(old);
+    }
+}
+
+// KEYRANGE start end [LIMIT n]: keys with start <= key < end, where an empty end has no upper
+// bound. KEYPREFIX prefix [LIMIT n]: keys starting with prefix. Both walk the key index from
+// the first key not below start (or prefix), in byte order.
+static void do_keyrange(uint8_t op, std::vector<std::string> &cmd, Response &out) {
+    size_t nfixed = op == OP_KEYRANGE ? 3 : 2;
+    uint64_t limit = kKeyRangeDefaultLimit;
+    if (cmd.size() == nfixed + 2 && cmd[nfixed] == "LIMIT") {
+        char *end = nullptr;
+        limit = strtoull(cmd[nfixed + 1].c_str(), &end, 10);
+        if (*end != '\0') {
+            out.status = RES_ERR;
+            return;
+        }
+        limit = std::min<uint64_t>(limit, kMaxArgs);  // the most a client can decode
+    } else if (cmd.size() != nfixed) {
+        out.status = RES_ERR;
+        return;
+    }
+    if (!g_data.opts.key_index) {
+        out.status = RES_ERR;
+        return;
+    }
+
+    const std::string &start = cmd[1];
+    std::vector<const std::string *> keys;
+    AVLNode *node = avl_lower_bound(g_data.key_index, &entry_key_below, &start);
+    for (; node && keys.size() < limit; node = avl_next(node)) {
+        const std::string &key = index_key(node);
+        bool past = op == OP_KEYRANGE ? !cmd[2].empty() && key >= cmd[2]
+                                      : key.compare(0, start.size(), start) != 0;
+        if (past) {
+            break;
+        }
+        keys.push_back(&key);
+    }
+    out_arr(out, keys.size());
+    for (const std::string *key : keys) {
+        out_arr_str(out, *key);
+    }
+}
+
+// HELLO [version]: switch the connection's protocol and reply with the version in effect. The
+// reply still uses the framing of the request.
+static void do_hello(Conn *conn, std::vector<std::string> &cmd, Response &out) {
+    uint32_t version = conn->proto;
+    if (cmd.size() == 2) {
+        char *end = nullptr;
+        version = (uint32_t)strtoul(cmd[1].c_str(), &end, 10);
+        if (*end != '\0' || (version != kProtoV1 && version != kProtoV2)) {
+            out.status = RES_ERR;
+            return;
+        }
+    }
+    conn->proto = version;
+    out_int(out, version);
+}
+
+// INFO: flattened (name, value) pairs: event loop, spill tier, pub/sub and lazy-free counters
+static void do_info(Response &out) {
+    const auto &loop = g_data.loop;
+    uint64_t total_us = loop.busy_us + loop.spin_us + loop.blocked_us;
+    uint64_t disk_bytes = 0, live_bytes = 0;
+    for (const auto &seg : g_data.tier.segs) {
+        if (seg) {
+            disk_bytes += seg->size;
+            live_bytes += seg->live;
+        }
     }
-
-    int rv = fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);  // modify and set the flags
-    if (errno) {
-        die(__LINE__, "%s: fcntl(), errno: %d", __func__, errno);
+    std::pair<const char *, std::string> fields[] = {
+        {"loop_iterations", std::to_string(loop.iterations)},
+        {"loop_events", std::to_string(loop.events)},
+        {"loop_busy_us", std::to_string(loop.busy_us)},
+        {"loop_spin_us", std::to_string(loop.spin_us)},
+        {"loop_blocked_us", std::to_string(loop.blocked_us)},
+        // Time handling events, as a share of the loop's wall time
+        {"loop_utilization_pct", std::to_string(total_us ? loop.busy_us * 100 / total_us : 0)},
+        {"spin_hits", std::to_string(loop.spin_hits)},
+        {"spin_misses", std::to_string(loop.spin_misses)},
+        {"spin_budget_us", std::to_string(g_data.spin_budget_us)},
+        {"cpu", std::to_string(g_data.opts.cpu)},
+        {"connections", std::to_string(std::count_if(g_data.fd2conn.begin(),
+                                                     g_data.fd2conn.end(),
+                                                     [](Conn *c) { return c != nullptr; }))},
+        {"keys", std::to_string(g_data.db.size())},
+        {"spill_resident_bytes", std::to_string(g_data.tier.resident_bytes)},
+        {"spill_keys", std::to_string(g_data.tier.spilled_keys)},
+        {"spill_disk_bytes", std::to_string(disk_bytes)},
+        {"spill_live_bytes", std::to_string(live_bytes)},
+        {"spill_reads", std::to_string(g_data.tier.reads)},
+        {"spill_compactions", std::to_string(g_data.tier.compactions)},
+        {"pubsub_channels", std::to_string(g_data.channels.size())},
+        {"pubsub_messages", std::to_string(g_data.published)},
+        {"pubsub_disconnects", std::to_string(g_data.pubsub_disconnects)},
+        {"lazyfree_pending", std::to_string(g_data.lazy_free.pending.load())},
+        {"sched_yields", std::to_string(g_data.sched_yields)},
+        {"output_pauses", std::to_string(g_data.output_pauses)},
+        {"run_queue", std::to_string(g_data.run_queue.size())},
+    };
+    out_arr(out, sizeof(fields) / sizeof(fields[0]) * 2);
+    for (const auto &field : fields) {
+        out_arr_str(out, field.first);
+        out_arr_str(out, field.second);
     }
-    return rv;
 }
 
-static void process_request(std::vector<std::string> &cmd, Response &out) {
+// cmd[0] is the command name in v1 and empty in v2; op already identifies the command
+static void process_request(Conn *conn, uint8_t op, std::vector<std::string> &cmd,
+                            Response &out) {
+    if (op == 0 || op >= OP_MAX || cmd.size() < kArity[op].min ||
+        (kArity[op].max && cmd.size() > kArity[op].max)) {
+        out.status = RES_ERR;
+        fprintf(stderr, "[ERROR] Invalid command.\n");
+        return;
+    }
+
+    // Keyspace events need the key name, which the handlers take out of cmd
+    bool notify = keyspace_wanted(op) && op != OP_UNLINK && op != OP_HDEL;
+    std::string name = notify ? cmd[1] : std::string();
+    bool wrote = false;
     LookupKey key;
-    if (cmd.size() == 2 && cmd[0] == "GET") {
-        key.key.swap(cmd[1]);
-        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-        HNode *node = g_data.db.lookup(&key.node, &entry_eq);
-        if (!node) {
-            out.status = RES_NX;
-            return;
-        } else {
-            Entry *ent = container_of(node, Entry, node);
-            out.data.assign(ent->str.begin(), ent->str.end());
+    switch (op) {
+        case OP_GET:
+            hotkey_track(g_data.hot_reads, cmd[1]);
+            do_get(conn, cmd, out);
+            break;
+        case OP_SET:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            do_set(cmd, out);
+            wrote = out.status != RES_ERR && out.status != RES_COND;
+            break;
+        case OP_GETSET:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            do_getset(cmd, out);
+            wrote = out.status != RES_ERR;
+            break;
+        case OP_DEL: {
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            lookup_key_init(key, cmd[1]);
+            wrote = key_del(key);
+            break;
         }
-    } else if (cmd.size() == 3 && cmd[0] == "SET") {
-        key.key.swap(cmd[1]);
-        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-        HNode *node = g_data.db.lookup(&key.node, &entry_eq);
-        if (node) {
-            Entry *ent = container_of(node, Entry, node);
-            ent->str.swap(cmd[2]);
-        } else {
-            Entry *ent = entry_new();
-            ent->key.swap(key.key);
-            ent->node.hcode = key.node.hcode;
-            ent->str.swap(cmd[2]);
-            g_data.db.insert(&ent->node);
-        }
-    } else if (cmd.size() == 2 && cmd[0] == "DEL") {
-        key.key.swap(cmd[1]);
-        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-        HNode *node = g_data.db.hm_delete(&key.node, &entry_eq);
-        if (node) {
-            entry_del(container_of(node, Entry, node));
+        case OP_PFADD:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            wrote = do_pfadd(cmd, out);
+            break;
+        case OP_PFCOUNT:
+            hotkey_track(g_data.hot_reads, cmd[1]);
+            do_pfcount(cmd, out);
+            break;
+        case OP_PFMERGE:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            do_pfmerge(cmd, out);
+            wrote = out.status != RES_ERR;
+            break;
+        case OP_HSET:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            do_hset(cmd, out);
+            wrote = out.status != RES_ERR;
+            break;
+        case OP_HGET:
+            hotkey_track(g_data.hot_reads, cmd[1]);
+            do_hget(cmd, out);
+            break;
+        case OP_HMGET:
+            hotkey_track(g_data.hot_reads, cmd[1]);
+            do_hmget(cmd, out);
+            break;
+        case OP_HDEL:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            do_hdel(cmd, out);
+            break;
+        case OP_HGETALL:
+            hotkey_track(g_data.hot_reads, cmd[1]);
+            do_hgetall(cmd, out);
+            break;
+        case OP_TRACKING:
+            do_tracking(conn, cmd, out);
+            break;
+        case OP_HOTKEYS:
+            do_hotkeys(cmd, out);
+            break;
+        case OP_HELLO:
+            do_hello(conn, cmd, out);
+            break;
+        case OP_INFO:
+            do_info(out);
+            break;
+        case OP_BULKLOAD:
+            do_bulkload(cmd, out);
+            break;
+        case OP_KEYRANGE:
+        case OP_KEYPREFIX:
+            do_keyrange(op, cmd, out);
+            break;
+        case OP_SUBSCRIBE:
+            do_subscribe(conn, cmd, out);
+            break;
+        case OP_UNSUBSCRIBE:
+            do_unsubscribe(conn, cmd, out);
+            break;
+        case OP_PUBLISH:
+            do_publish(cmd, out);
+            break;
+        case OP_UNLINK:
+            hotkey_track(g_data.hot_writes, cmd[1]);
+            do_unlink(cmd, out);
+            break;
+        case OP_FLUSHALL:
+            do_flushall(cmd, out);
+            break;
+    }
+    if (notify && wrote) {
+        keyspace_notify(name, keyspace_event(op));
+    }
+}
+
+// Drop bytes that were sent: first from the shared frames, then from outgoing
+static void conn_consume(Conn *conn, size_t bytes) {
+    while (bytes > 0 && !conn->shared.empty()) {
+        size_t left = conn->shared.front()->size() - conn->shared_sent;
+        size_t n = std::min(left, bytes);
+        conn->shared_sent += n;
+        conn->shared_bytes -= n;
+        bytes -= n;
+        if (n == left) {
+            conn->shared.pop_front();
+            conn->shared_sent = 0;
         }
-    } else {
-        out.status = RES_ERR;
-        fprintf(stderr, "[ERROR] Invalid command.\n");
     }
+    buffer_consume(conn->outgoing, bytes);
 }
 
 static void handle_write(Conn *conn) {
     errno = 0;
-    if (conn->outgoing.size() > 0) {
-        ssize_t bytes = send(conn->fd, conn->outgoing.data(), conn->outgoing.size(), MSG_NOSIGNAL);
+    if (conn_has_output(conn)) {
+        // One gather write for the shared frames and outgoing; outgoing only goes once every
+        // frame before it fits in the same call
+        struct iovec iov[kMaxWriteIov];
+        size_t niov = 0;
+        for (const auto &frame : conn->shared) {
+            if (niov == kMaxWriteIov) {
+                break;
+            }
+            size_t skip = niov == 0 ? conn->shared_sent : 0;
+            iov[niov].iov_base = (void *)(frame->data() + skip);
+            iov[niov++].iov_len = frame->size() - skip;
+        }
+        if (niov == conn->shared.size() && niov < kMaxWriteIov && !conn->outgoing.empty()) {
+            iov[niov].iov_base = conn->outgoing.data();
+            iov[niov++].iov_len = conn->outgoing.size();
+        }
+        struct msghdr mh = {};
+        mh.msg_iov = iov;
+        mh.msg_iovlen = niov;
+        ssize_t bytes = sendmsg(conn->fd, &mh, MSG_NOSIGNAL);
         if (bytes < 0 && errno == EAGAIN) {
             return;  // Socket not ready, will try later
         }
@@ -139,10 +2015,11 @@ static void handle_write(Conn *conn) {
         }
 
         // Remove written data
-        buffer_consume(conn->outgoing, (size_t)bytes);
+        conn_consume(conn, (size_t)bytes);
+        CACHEX_TRACE3(conn_flush, conn->fd, bytes, conn->shared_bytes + conn->outgoing.size());
 
         // Update the readiness intention
-        if (conn->outgoing.empty()) {  // all data written
+        if (!conn_has_output(conn)) {  // all data written
             conn->want_read = true;
             conn->want_write = false;
         }  // else: want write
@@ -174,37 +2051,58 @@ static bool handle_client_request(Conn *conn) {
         conn->want_close = true;
         return false;
     }
-    if (conn->incoming.size() < kHeaderSize + len) {
-        fprintf(stderr, "[DEBUG] Incomplete message, waiting for more data...\n");
-        return false;
-    }
-
     // Wait until we receive the full payload
     if (kHeaderSize + len > conn->incoming.size()) {
         return false;
     }
+    CACHEX_TRACE2(request_start, conn->fd, len);
 
     const uint8_t *request = &conn->incoming[kHeaderSize];
     std::vector<std::string> command;
-    if (parse_request(request, len, command) < 0) {
+    V2Header hdr;
+    uint32_t proto = conn->proto;  // HELLO may change it, but not for its own reply
+    int32_t rv = proto == kProtoV2 ? parse_request_v2(request, len, hdr, command)
+                                   : parse_request(request, len, command);
+    if (rv < 0) {
         msg(__LINE__, "%s: Bad request");
         conn->want_close = true;
         return false;
     }
+    if (proto == kProtoV1) {
+        hdr.op = command.empty() ? 0 : opcode_lookup(command[0]);
+    }
+    CACHEX_TRACE4(request_parsed, conn->fd, hdr.op, kOpcodeNames[hdr.op < OP_MAX ? hdr.op : 0],
+                  command.size() > 1 ? command[1].size() : 0);
+    if (tier_must_wait(conn, hdr.op, command)) {
+        conn->blocked = true;  // this and later requests wait until the value is in memory
+        return false;
+    }
+#ifdef CACHEX_DEBUG_DUMP
     std::string result = std::accumulate(
         command.begin(), command.end(), std::string(),
         [](const std::string &a, const std::string &b) { return a.empty() ? b : a + " " + b; });
-    fprintf(stderr, "[DEBUG] Client %d (len: %d) request: %s\n", conn->fd, len, result.c_str());
+    fprintf(stderr, "[DEBUG] Client %d (len: %d, op: %u) request: %s\n", conn->fd, len, hdr.op,
+            result.c_str());
+#endif
 
     Response response;
-    process_request(command, response);
-    create_response(response, conn->outgoing);
-    // print_response(conn->outgoing);
-    fprintf(stderr, "[DEBUG] outgoing data (size=%lu): ", conn->outgoing.size());
-    for (size_t i = 0; i < conn->outgoing.size(); i++) {
+    process_request(conn, hdr.op, command, response);
+    size_t reply_start = conn->outgoing.size();
+    if (proto == kProtoV1) {
+        create_response(response, conn->outgoing);
+    } else if (!(hdr.flags & V2_FLAG_QUIET) || response.status == RES_ERR) {
+        create_response_v2(response, hdr.flags, hdr.id, conn->outgoing);
+    }
+    CACHEX_TRACE4(request_done, conn->fd, hdr.op, response.status,
+                  conn->outgoing.size() - reply_start);
+#ifdef CACHEX_DEBUG_DUMP
+    // Only dump this reply: with pipelined requests the whole buffer would be dumped repeatedly
+    fprintf(stderr, "[DEBUG] outgoing data (size=%lu): ", conn->outgoing.size() - reply_start);
+    for (size_t i = reply_start; i < conn->outgoing.size(); i++) {
         fprintf(stderr, "%02X ", conn->outgoing[i]);
     }
     fprintf(stderr, "\n");
+#endif
 
     // Application logic is done, remove the request message
     buffer_consume(conn->incoming, kHeaderSize + len);
@@ -212,57 +2110,118 @@ static bool handle_client_request(Conn *conn) {
     return true;
 }
 
-static void handle_read(Conn *conn) {
-    uint8_t buf[64 * 1024];
-    errno = 0;
-    ssize_t bytes = recv(conn->fd, buf, sizeof(buf), MSG_DONTWAIT);
-    if (bytes < 0 && errno == EAGAIN) {
-        return;
+// Whether the connection may run requests now. One whose replies are not being read stops at
+// --output-limit until handle_write() has drained it, instead of buffering without bound.
+static bool conn_can_run(const Conn *conn) {
+    return !conn->blocked && !conn->want_close &&
+           conn_output_bytes(conn) < g_data.opts.output_limit;
+}
+
+// A complete request is buffered (or a bad header, which closes the connection when run)
+static bool conn_has_request(const Conn *conn) {
+    if (conn->incoming.size() < kHeaderSize) {
+        return false;
     }
+    uint32_t len = 0;
+    memcpy(&len, conn->incoming.data(), kHeaderSize);
+    return len > kMaxPayloadSize || conn->incoming.size() >= kHeaderSize + len;
+}
 
-    // IO error
-    if (bytes < 0) {
-        msg(__LINE__, "%s: recv(), errno: %d", __func__, errno);
-        conn->want_close = true;
+// Put a connection with work left over on the run queue, for a turn in a later iteration
+static void conn_schedule(Conn *conn) {
+    if (conn->run_queued || !conn_can_run(conn) || !(conn->unread || conn_has_request(conn))) {
         return;
     }
+    conn->run_queued = true;
+    g_data.run_queue.emplace_back(conn->fd, conn->id);
+}
 
-    // EOF
-    if (bytes == 0) {
-        if (conn->incoming.size() == 0) {
-            fprintf(stderr, "[INFO] Client %d disconnected.\n", conn->fd);
-        } else {
-            fprintf(stderr, "[WARNING] Client %d disconnected unexpectedly with partial data.\n",
-                    conn->fd);
+// Run the complete requests in the incoming buffer, in order, at most budget of them
+static void handle_requests(Conn *conn, uint32_t &budget) {
+    while (budget > 0 && conn_can_run(conn) && conn->incoming.size() >= kHeaderSize) {
+        if (!handle_client_request(conn)) {
+            break;
         }
-        conn->want_close = true;
-        return;  // want close
+        budget--;
     }
+}
 
-    // Ignore empty messages
-    if (bytes == kHeaderSize && buf[0] == 0) {
-        fprintf(stderr, "[WARNING] Client %d sent an empty request.\n", conn->fd);
-        return;
-    }
+// One turn of a connection: at most --turn-requests requests and about --turn-bytes of input,
+// so a client pipelining a large batch can't hold up everyone else. Requests already buffered
+// go first; what is left when the budget runs out is served on a later turn.
+static void handle_read(Conn *conn) {
+    uint8_t buf[64 * 1024];
+    uint32_t budget = g_data.opts.turn_requests;
+    uint64_t read = 0;
+    handle_requests(conn, budget);
+    // Edge-triggered epoll reports new data only once, so keep reading until the socket is
+    // drained or a short read shows there is nothing left. Until then unread stays set, which
+    // keeps the connection on the run queue when the turn ends early.
+    conn->unread = true;
+    while (budget > 0 && conn_can_run(conn)) {
+        errno = 0;
+        ssize_t bytes = recv(conn->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (bytes < 0 && errno == EAGAIN) {
+            conn->unread = false;
+            break;
+        }
 
-    buffer_append(conn->incoming, buf, (size_t)bytes);
-    while (conn->incoming.size() >= kHeaderSize) {
-        if (!handle_client_request(conn)) {
+        // IO error
+        if (bytes < 0) {
+            msg(__LINE__, "%s: recv(), errno: %d", __func__, errno);
+            conn->want_close = true;
+            return;
+        }
+
+        // EOF
+        if (bytes == 0) {
+            if (conn->incoming.size() == 0) {
+                fprintf(stderr, "[INFO] Client %d disconnected.\n", conn->fd);
+            } else {
+                fprintf(stderr,
+                        "[WARNING] Client %d disconnected unexpectedly with partial data.\n",
+                        conn->fd);
+            }
+            conn->want_close = true;
+            return;  // want close
+        }
+
+        // Ignore empty messages, but finish the turn: requests served above still need their
+        // replies flushed
+        if (bytes == kHeaderSize && buf[0] == 0) {
+            fprintf(stderr, "[WARNING] Client %d sent an empty request.\n", conn->fd);
+            continue;
+        }
+
+        buffer_append(conn->incoming, buf, (size_t)bytes);
+        handle_requests(conn, budget);
+        conn->unread = (size_t)bytes == sizeof(buf);
+        read += (uint64_t)bytes;
+        if (!conn->unread || read >= g_data.opts.turn_bytes) {
             break;
         }
     }
+    if (conn->want_close) {
+        return;
+    }
+    if (!conn->blocked && conn_output_bytes(conn) >= g_data.opts.output_limit) {
+        g_data.output_pauses++;
+    } else if (conn_can_run(conn) && (conn->unread || conn_has_request(conn))) {
+        g_data.sched_yields++;
+    }
 
     // Update the readiness intention
-    if (!conn->outgoing.empty()) {  // has a response
+    if (conn_has_output(conn)) {  // has a response
         conn->want_read = false;
         conn->want_write = true;
         // The socket is likely ready to write in a request-response protocol,
         // try to write it without waiting for the next iteration.
-        return handle_write(conn);
+        handle_write(conn);
     }  // else: want read
+    conn_schedule(conn);
 }
 
-void start_server() {
+static int listen_tcp(int port) {
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
         die(__LINE__, "%s: socket(), errno: %d", __func__, errno);
@@ -277,7 +2236,7 @@ void start_server() {
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;  // OR htonl(0)
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(port);
 
     int rv = bind(server_fd, (const struct sockaddr *)&server_addr, sizeof(server_addr));
     if (rv) {
@@ -289,48 +2248,554 @@ void start_server() {
     if (rv) {
         die(__LINE__, "%s: listen(), errno: %d", __func__, errno);
     }
+    return server_fd;
+}
+
+// Same-host clients skip the TCP/IP stack entirely through a Unix domain socket
+static int listen_unix(const std::string &path) {
+    struct sockaddr_un server_addr = {};
+    if (path.size() >= sizeof(server_addr.sun_path)) {
+        die(__LINE__, "%s: socket path too long: %s", __func__, path.c_str());
+    }
+    server_addr.sun_family = AF_UNIX;
+    memcpy(server_addr.sun_path, path.c_str(), path.size() + 1);
+
+    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        die(__LINE__, "%s: socket(), errno: %d", __func__, errno);
+    }
+    set_nonblocking(server_fd);
+
+    unlink(path.c_str());  // stale socket file from a previous run
+    if (bind(server_fd, (const struct sockaddr *)&server_addr, sizeof(server_addr))) {
+        die(__LINE__, "%s: bind(%s), errno: %d", __func__, path.c_str(), errno);
+    }
+    if (listen(server_fd, SOMAXCONN)) {
+        die(__LINE__, "%s: listen(), errno: %d", __func__, errno);
+    }
+    return server_fd;
+}
+
+static void tune_client_socket(int client_fd, const ServerOptions &opts) {
+    int level = 1;
+    // Replies are small and written in one send(), so Nagle only adds delay
+    if (opts.tcp_nodelay &&
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &level, sizeof(level)) < 0) {
+        msg(__LINE__, "%s: setsockopt(TCP_NODELAY), errno: %d", __func__, errno);
+    }
+    // Busy polling the device queue on a blocking read trades CPU for wake-up latency.
+    // Raising it above net.core.busy_read needs CAP_NET_ADMIN.
+    if (opts.busy_poll_us > 0 && setsockopt(client_fd, SOL_SOCKET, SO_BUSY_POLL,
+                                            &opts.busy_poll_us, sizeof(opts.busy_poll_us)) < 0) {
+        msg(__LINE__, "%s: setsockopt(SO_BUSY_POLL), errno: %d", __func__, errno);
+    }
+}
+
+static void accept_clients(int epoll_fd, int listen_fd, bool is_tcp, const ServerOptions &opts) {
+    while (true) {  // Accept all pending connections
+        struct sockaddr_storage client_addr = {};
+        socklen_t client_len = sizeof(client_addr);
+        // accept4() hands back a non-blocking socket, saving two fcntl() calls per connection
+        int client_fd = accept4(listen_fd, (struct sockaddr *)&client_addr, &client_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                msg(__LINE__, "accept() error");
+            }
+            break;
+        }
+
+        if (is_tcp) {
+            tune_client_socket(client_fd, opts);
+        }
+
+        if (g_data.fd2conn.size() <= (size_t)client_fd) {
+            g_data.fd2conn.resize(client_fd + 1);
+        }
+        if (g_data.fd2conn[client_fd] != nullptr) {
+            fprintf(stderr, "[WARNING] Reusing file descriptor %d for new connection.\n",
+                    client_fd);
+        }
+        Conn *conn = new Conn();
+        conn->fd = client_fd;
+        conn->id = ++g_data.next_conn_id;
+        g_data.fd2conn[client_fd] = conn;
+        struct epoll_event event = {};
+        // EPOLLOUT is needed to resume a partially flushed response
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.fd = client_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
+        if (is_tcp) {
+            struct sockaddr_in *addr = (struct sockaddr_in *)&client_addr;
+            printf("New client connected: %d from %s:%d\n", client_fd, inet_ntoa(addr->sin_addr),
+                   ntohs(addr->sin_port));
+        } else {
+            printf("New client connected: %d from unix socket\n", client_fd);
+        }
+    }
+}
+
+static void conn_destroy(int epoll_fd, Conn *conn) {
+    while (!conn->channels.empty()) {
+        pubsub_unsubscribe(conn, std::string(conn->channels.back()));
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    g_data.fd2conn[conn->fd] = nullptr;
+    delete conn;
+}
+
+// Send the messages conn_push() queued for connections that had no event of their own
+static void flush_pushes(int epoll_fd) {
+    for (const auto &item : g_data.write_queue) {
+        Conn *conn = conn_lookup(item.first, item.second);
+        if (!conn) {
+            continue;
+        }
+        conn->flush_queued = false;
+        if (!conn->want_close) {
+            handle_write(conn);
+            conn_schedule(conn);  // it may have been waiting for its output to drain
+        }
+        if (conn->want_close) {
+            conn_destroy(epoll_fd, conn);
+        }
+    }
+    g_data.write_queue.clear();
+}
+
+// Run the queued requests of connections whose value has been read back
+static void resume_blocked(int epoll_fd) {
+    std::vector<std::pair<int, uint64_t>> ready;
+    ready.swap(g_data.tier.ready);
+    for (const auto &item : ready) {
+        Conn *conn = conn_lookup(item.first, item.second);
+        if (!conn) {
+            continue;
+        }
+        conn->blocked = false;
+        handle_read(conn);
+        if (conn->want_close) {
+            conn_destroy(epoll_fd, conn);
+        }
+    }
+}
+
+// Give every connection on the run queue one more turn. Those still not done queue again, behind
+// whatever arrived meanwhile.
+static void run_ready(int epoll_fd) {
+    std::vector<std::pair<int, uint64_t>> ready;
+    ready.swap(g_data.run_queue);
+    for (const auto &item : ready) {
+        Conn *conn = conn_lookup(item.first, item.second);
+        if (!conn) {
+            continue;
+        }
+        conn->run_queued = false;
+        handle_read(conn);
+        if (conn->want_close) {
+            conn_destroy(epoll_fd, conn);
+        }
+    }
+}
+
+// Zero-downtime restart. A new process started with the same --handoff path connects to the
+// running one, which passes it the listening sockets (SCM_RIGHTS) and then streams the whole
+// keyspace. Until the new process has loaded it, incoming connections wait in the shared accept
+// queue. The old process stops reading requests as soon as the snapshot is taken, flushes the
+// replies it owes and exits; its clients see EOF and reconnect to the new one.
+enum HandoffListener {
+    HANDOFF_TCP = 1 << 0,
+    HANDOFF_UNIX = 1 << 1,
+};
+
+static int send_listeners(int sock, int tcp_fd, int unix_fd) {
+    uint32_t kinds = HANDOFF_TCP | (unix_fd >= 0 ? HANDOFF_UNIX : 0);
+    int fds[2] = {tcp_fd, unix_fd};
+    size_t nfds = unix_fd >= 0 ? 2 : 1;
+
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct iovec iov = {&kinds, sizeof(kinds)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(kinds) ? 0 : -1;
+}
+
+static int recv_listeners(int sock, int *tcp_fd, int *unix_fd) {
+    uint32_t kinds = 0;
+    int fds[2] = {-1, -1};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct iovec iov = {&kinds, sizeof(kinds)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(kinds)) {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+    *tcp_fd = (kinds & HANDOFF_TCP) ? fds[0] : -1;
+    *unix_fd = (kinds & HANDOFF_UNIX) ? fds[1] : -1;
+    return 0;
+}
+
+// Returns false when a spilled value can't be read back: the snapshot would be incomplete
+static bool snapshot_entry(Entry *ent, std::vector<uint8_t> &buf) {
+    if (ent->type == T_STR && tier_spilled(ent)) {
+        // The old process is about to exit, so a synchronous read is fine here
+        TierNode *tn = ent->tier;
+        std::string value(tn->spill_len, '\0');
+        if (spill_pread(g_data.tier.segs[tn->spill_seg]->fd, &value[0], value.size(),
+                        tn->spill_off) < 0) {
+            msg(__LINE__, "%s: reading %s back failed, errno: %d", __func__, ent->key.c_str(),
+                errno);
+            return false;
+        }
+        snapshot_put_record(buf, REC_STR, ent->version, ent->key, (const uint8_t *)value.data(),
+                            value.size());
+    } else if (ent->type == T_STR) {
+        snapshot_put_record(buf, REC_STR, ent->version, ent->key,
+                            (const uint8_t *)ent->str.data(), ent->str.size());
+    } else if (ent->type == T_HLL) {
+        const HyperLogLog &hll = *ent->hll;
+        const uint8_t *regs = hll.dense ? hll.regs.data() : (const uint8_t *)hll.sparse.data();
+        size_t nregs = hll.dense ? hll.regs.size() : hll.sparse.size() * sizeof(uint32_t);
+        std::vector<uint8_t> value(1 + nregs);
+        value[0] = hll.dense;
+        if (nregs) {
+            memcpy(value.data() + 1, regs, nregs);
+        }
+        snapshot_put_record(buf, REC_HLL, ent->version, ent->key, value.data(), value.size());
+    } else {
+        Response pairs;
+        out_arr(pairs, hash_size(*ent->hash) * 2);
+        hash_foreach(*ent->hash, [&pairs](const std::string &field, const std::string &value) {
+            out_arr_str(pairs, field);
+            out_arr_str(pairs, value);
+        });
+        snapshot_put_record(buf, REC_HASH, ent->version, ent->key, pairs.data.data(),
+                            pairs.data.size());
+    }
+    return true;
+}
+
+static bool restore_entry(SnapshotRecord &rec) {
+    Entry *ent = entry_from_record(rec);
+    if (!ent) {
+        return false;
+    }
+    if (ent->version == 0) {
+        ent->version = ++g_data.last_version;  // a version 1 stream, from before CAS
+    }
+    g_data.last_version = std::max(g_data.last_version, ent->version);
+    g_data.db.insert(&ent->node);
+    key_index_add(ent);
+    tier_track(ent);
+    return true;
+}
+
+// Runs on the old process. The whole snapshot is written from the event loop, so it reflects
+// every request processed so far and nothing after it. On failure the stream ends without
+// REC_END, so the new process gives up and this one keeps serving.
+static bool handoff_send(int sock, int tcp_fd, int unix_fd) {
+    if (send_listeners(sock, tcp_fd, unix_fd) < 0) {
+        msg(__LINE__, "%s: sendmsg(), errno: %d", __func__, errno);
+        return false;
+    }
+
+    struct Stream {
+        int sock;
+        bool ok;
+        std::vector<uint8_t> buf;
+    } stream = {sock, true, {}};
+    snapshot_put_header(stream.buf);
+    g_data.db.foreach (
+        [](HNode *node, void *arg) {
+            Stream *stream = (Stream *)arg;
+            stream->ok = snapshot_entry(container_of(node, Entry, node), stream->buf);
+            if (stream->ok && stream->buf.size() >= kHandoffChunk) {
+                stream->ok = write_all(stream->sock, stream->buf.data(), stream->buf.size()) == 0;
+                stream->buf.clear();
+            }
+            return stream->ok;
+        },
+        &stream);
+    snapshot_put_end(stream.buf);
+    return stream.ok && write_all(sock, stream.buf.data(), stream.buf.size()) == 0;
+}
+
+// Runs on the new process before it serves anything. Returns false when nobody is listening
+// on path, i.e. this is a cold start.
+static bool handoff_receive(const std::string &path, int *tcp_fd, int *unix_fd) {
+    struct sockaddr_un addr = {};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        die(__LINE__, "%s: socket path too long: %s", __func__, path.c_str());
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (sock >= 0) {
+            close(sock);
+        }
+        return false;
+    }
+
+    // From here on the old process has stopped serving, so any failure is fatal
+    if (recv_listeners(sock, tcp_fd, unix_fd) < 0 || *tcp_fd < 0) {
+        die(__LINE__, "%s: did not receive the listening sockets", __func__);
+    }
+    std::vector<uint8_t> buf;
+    size_t pos = 0, nkeys = 0;
+    int32_t version = 0;  // of the stream, 0 until its header is in
+    SnapshotRecord rec;
+    uint8_t chunk[64 * 1024];
+    while (true) {
+        if (!version && buf.size() >= kSnapshotHeaderSize) {
+            version = snapshot_check_header(buf.data());
+            if (version < 0) {
+                die(__LINE__, "%s: bad snapshot header", __func__);
+            }
+            pos = kSnapshotHeaderSize;
+        }
+        int64_t n = 0;
+        while (version &&
+               (n = snapshot_next(buf.data() + pos, buf.size() - pos, rec, version)) > 0) {
+            pos += n;
+            if (rec.type == REC_END) {
+                close(sock);
+                printf("Took over %zu keys from %s\n", nkeys, path.c_str());
+                return true;
+            }
+            if (!restore_entry(rec)) {
+                die(__LINE__, "%s: bad record for key %s", __func__, rec.key.c_str());
+            }
+            nkeys++;
+        }
+        if (n < 0) {
+            die(__LINE__, "%s: malformed snapshot", __func__);
+        }
+        buffer_consume(buf, pos);
+        pos = 0;
+        if (tier_enabled()) {
+            tier_spill(get_monotonic_ms());  // a dataset larger than memory must not load at once
+        }
+        ssize_t bytes = recv(sock, chunk, sizeof(chunk), 0);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            die(__LINE__, "%s: snapshot stream ended early", __func__);
+        }
+        buffer_append(buf, chunk, (size_t)bytes);
+    }
+}
+
+// After a handoff the keyspace belongs to the new process, so requests this one has not run
+// yet can't be applied any more: whether waiting for their turn, for a spilled value or for the
+// client to read its replies. Answer each complete one with RES_ERR, including those already
+// in the socket, so the client knows to retry it on the new process.
+static void fail_pending(Conn *conn) {
+    uint8_t buf[64 * 1024];
+    ssize_t bytes = 0;
+    while (conn->incoming.size() < kHandoffChunk &&
+           (bytes = recv(conn->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        buffer_append(conn->incoming, buf, (size_t)bytes);
+    }
+    while (conn_fail_request(conn)) {
+    }
+    conn->blocked = false;
+}
+
+// After a handoff: no more requests run, just deliver the replies owed, then close everything
+static void drain_connections(int epoll_fd) {
+    uint64_t deadline = get_monotonic_ms() + kHandoffDrainMs;
+    struct epoll_event events[MAX_EVENTS];
+    for (Conn *conn : g_data.fd2conn) {
+        if (conn && !conn->want_close) {
+            fail_pending(conn);
+            handle_write(conn);
+        }
+    }
+    while (true) {
+        size_t live = 0;
+        for (Conn *conn : g_data.fd2conn) {
+            if (!conn) {
+                continue;
+            }
+            if (!conn_has_output(conn) || conn->want_close) {
+                conn_destroy(epoll_fd, conn);
+            } else {
+                live++;
+            }
+        }
+        if (live == 0 || get_monotonic_ms() >= deadline) {
+            break;
+        }
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        for (int i = 0; i < num_events; i++) {
+            Conn *conn = g_data.fd2conn[events[i].data.fd];
+            if (conn && (events[i].events & EPOLLOUT)) {
+                handle_write(conn);
+            }
+        }
+    }
+    for (Conn *conn : g_data.fd2conn) {
+        if (conn) {
+            conn_destroy(epoll_fd, conn);
+        }
+    }
+}
+
+// Wait for events. With a spin budget the loop first polls with a zero timeout, which avoids
+// the sleep/wake-up cost when the next request comes soon. A spin that runs out halves the
+// next budget (down to 1/8) so an idle server backs off; one that finds work restores it.
+// A timeout of 0 polls once, for when the loop has work of its own left.
+static int loop_wait(int epoll_fd, struct epoll_event *events, int timeout_ms) {
+    auto &loop = g_data.loop;
+    loop.iterations++;
+    uint64_t start = get_monotonic_us();
+    int num_events = 0;
+    if (g_data.spin_budget_us > 0 && timeout_ms != 0) {
+        uint64_t deadline = start + g_data.spin_budget_us, now = start;
+        do {
+            num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, 0);
+            now = get_monotonic_us();
+        } while (num_events == 0 && now < deadline);
+        loop.spin_us += now - start;
+        if (num_events != 0) {
+            loop.spin_hits++;
+            g_data.spin_budget_us = g_data.opts.spin_us;
+            loop.events += num_events > 0 ? num_events : 0;
+            return num_events;
+        }
+        loop.spin_misses++;
+        g_data.spin_budget_us = std::max(g_data.spin_budget_us / 2, g_data.opts.spin_us / 8);
+        start = now;
+    }
+    num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    loop.blocked_us += get_monotonic_us() - start;
+    loop.events += num_events > 0 ? num_events : 0;
+    return num_events;
+}
+
+// CPUs this process may run on, which can be fewer than the machine has (taskset, cgroups)
+static size_t usable_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return 1;
+    }
+    return std::max(CPU_COUNT(&set), 1);
+}
+
+// Keep the event loop on one core so it never migrates and loses its caches. Threads created
+// later inherit the mask.
+static void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        msg(__LINE__, "%s: sched_setaffinity(%d), errno: %d", __func__, cpu, errno);
+    } else {
+        printf("Event loop pinned to CPU %d\n", cpu);
+    }
+}
+
+void start_server(const ServerOptions &opts) {
+    g_data.opts = opts;
+    int server_fd = -1, unix_fd = -1, handoff_fd = -1;
+    if (lazy_free_init(g_data.lazy_free) < 0) {
+        die(__LINE__, "%s: can't start the lazy-free thread", __func__);
+    }
+    if (tier_enabled()) {
+        tier_init();  // before a handoff, so the incoming dataset can spill
+    }
+    // Before pin_to_cpu(), which the workers would inherit. One CPU is the loop thread's own.
+    if (thread_pool_init(g_data.bulk_pool, usable_cpus() - 1) < 0) {
+        die(__LINE__, "%s: can't start the bulk load threads", __func__);
+    }
+    if (!opts.handoff_path.empty()) {
+        handoff_receive(opts.handoff_path, &server_fd, &unix_fd);
+    }
+    if (server_fd < 0) {
+        server_fd = listen_tcp(opts.port);
+    }
+    if (unix_fd < 0 && !opts.unix_path.empty()) {
+        unix_fd = listen_unix(opts.unix_path);
+    }
+    if (!opts.handoff_path.empty()) {
+        handoff_fd = listen_unix(opts.handoff_path);  // for the next upgrade
+    }
 
-    printf("Server started on port %d, ready for GET/SET...\n", PORT);
+    if (opts.cpu >= 0) {
+        pin_to_cpu(opts.cpu);
+    }
+    g_data.spin_budget_us = opts.spin_us;
+
+    printf("Server started on port %d, ready for GET/SET...\n", opts.port);
+    if (unix_fd >= 0) {
+        printf("Listening on unix socket %s\n", opts.unix_path.c_str());
+    }
+    fflush(stdout);
 
     struct epoll_event event, events[MAX_EVENTS];
     int epoll_fd = epoll_create1(0);
     event.events = EPOLLIN | EPOLLET;
     event.data.fd = server_fd;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event);
+    if (unix_fd >= 0) {
+        event.data.fd = unix_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, unix_fd, &event);
+    }
+    if (handoff_fd >= 0) {
+        event.data.fd = handoff_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handoff_fd, &event);
+    }
+    int io_fd = g_data.tier.pool.efd;
+    if (io_fd >= 0) {
+        event.events = EPOLLIN;
+        event.data.fd = io_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, io_fd, &event);
+    }
 
-    while (true) {
-        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        for (int i = 0; i < num_events; i++) {
+    bool handed_off = false;
+    while (!handed_off) {
+        bool pending = tier_behind() || !g_data.run_queue.empty();
+        int num_events = loop_wait(epoll_fd, events, pending ? 0 : -1);
+        uint64_t busy_start = get_monotonic_us();
+        hotkey_decay(busy_start / 1000);
+        run_ready(epoll_fd);
+        for (int i = 0; i < num_events && !handed_off; i++) {
             int fd = events[i].data.fd;
-            if (fd == server_fd) {
-                while (true) {  // Accept all pending connections
-                    struct sockaddr_in client_addr = {};
-                    socklen_t client_len = sizeof(client_addr);
-                    int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
-                    if (client_fd < 0) {
-                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                            msg(__LINE__, "accept() error");
-                        }
-                        break;
-                    }
-
-                    set_nonblocking(client_fd);
-
-                    if (g_data.fd2conn.size() <= (size_t)client_fd) {
-                        g_data.fd2conn.resize(client_fd + 1);
-                    }
-                    if (g_data.fd2conn[client_fd] != nullptr) {
-                        fprintf(stderr,
-                                "[WARNING] Reusing file descriptor %d for new connection.\n",
-                                client_fd);
-                    }
-                    g_data.fd2conn[client_fd] = new Conn{client_fd, true, false, false, {}, {}};
-                    event.events = EPOLLIN | EPOLLET;
-                    event.data.fd = client_fd;
-                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
-                    printf("New client connected: %d from %s:%d\n", client_fd,
-                           inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+            if (fd == server_fd || fd == unix_fd) {
+                accept_clients(epoll_fd, fd, fd == server_fd, opts);
+            } else if (fd == handoff_fd) {
+                int sock = accept4(handoff_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (sock < 0) {
+                    continue;
                 }
+                handed_off = handoff_send(sock, server_fd, unix_fd);
+                if (!handed_off) {
+                    msg(__LINE__, "%s: handoff failed, still serving", __func__);
+                }
+                close(sock);
+            } else if (fd == io_fd) {
+                thread_pool_complete(g_data.tier.pool);
+                resume_blocked(epoll_fd);
             } else {
                 // Handle request for existing client
                 if (events[i].events == 0) {
@@ -338,21 +2803,43 @@ void start_server() {
                 }
 
                 Conn *conn = g_data.fd2conn[fd];
+                if (!conn) {
+                    continue;  // closed earlier in this iteration
+                }
                 if (events[i].events & EPOLLIN) {
                     handle_read(conn);
                 }
                 if (events[i].events & EPOLLOUT) {
                     handle_write(conn);
+                    conn_schedule(conn);
                 }
                 if (conn->want_close) {
-                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
-                    close(conn->fd);
-                    g_data.fd2conn[conn->fd] = nullptr;
-                    delete conn;
+                    conn_destroy(epoll_fd, conn);
                 }
             }
         }
+        flush_pushes(epoll_fd);
+        if (tier_enabled()) {
+            tier_maintain(get_monotonic_ms());
+        }
+        g_data.loop.busy_us += get_monotonic_us() - busy_start;
     }
 
+    // The new process owns the listening sockets and socket paths now
     close(server_fd);
+    if (unix_fd >= 0) {
+        close(unix_fd);
+    }
+    if (handoff_fd >= 0) {
+        close(handoff_fd);
+    }
+    printf("Handed off to the new process, draining %s\n", opts.handoff_path.c_str());
+    fflush(stdout);
+    drain_connections(epoll_fd);
+    if (io_fd >= 0) {
+        thread_pool_destroy(g_data.tier.pool);
+    }
+    thread_pool_destroy(g_data.bulk_pool);
+    lazy_free_destroy(g_data.lazy_free);
+    close(epoll_fd);
 }
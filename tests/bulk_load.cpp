@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "bulk_file.hpp"
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "hyperloglog.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17381
+#define BULK_PATH "/tmp/cacheX_test_bulk.cxb"
+#define BAD_PATH "/tmp/cacheX_test_bulk_bad.cxb"
+#define NUM_KEYS 100000
+
+static std::string value_for(int i) { return "value_" + std::to_string(i); }
+
+// Small chunks, so the load is split between threads even for this little data
+static bool write_file(const char *path) {
+    BulkWriter writer;
+    writer.chunk_size = 64 * 1024;
+    if (!bulk_writer_open(writer, path)) {
+        return false;
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        std::string value = value_for(i);
+        bulk_writer_put(writer, REC_STR, "key_" + std::to_string(i),
+                        (const uint8_t *)value.data(), value.size());
+    }
+    bulk_writer_put(writer, REC_STR, "key_7", (const uint8_t *)"last", 4);  // the later one wins
+    return bulk_writer_close(writer) && writer.chunks.size() > 1;
+}
+
+static int64_t keys(int sock) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    cacheX_info(sock, fields);
+    for (const auto &field : fields) {
+        if (field.first == "keys") {
+            return strtoll(field.second.c_str(), nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+// Framed correctly, but the last record holds a HyperLogLog that does not decode
+static bool write_bad_value(const char *path, const std::vector<uint8_t> &hll) {
+    BulkWriter writer;
+    writer.chunk_size = 64 * 1024;
+    if (!bulk_writer_open(writer, path)) {
+        return false;
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        bulk_writer_put(writer, REC_STR, "key_" + std::to_string(i), (const uint8_t *)"bad", 3);
+    }
+    bulk_writer_put(writer, REC_HLL, "hll", hll.data(), hll.size());
+    return bulk_writer_close(writer) && writer.chunks.size() > 1;
+}
+
+// A sparse sketch: the 0 tag byte, then (index << 8 | rank) items
+static std::vector<uint8_t> sparse_hll(const std::vector<uint32_t> &items) {
+    std::vector<uint8_t> out(1, 0);
+    for (uint32_t item : items) {
+        out.insert(out.end(), (const uint8_t *)&item, (const uint8_t *)&item + sizeof(item));
+    }
+    return out;
+}
+
+static int run() {
+    if (!write_file(BULK_PATH)) {
+        return fail("writing the bulk file");
+    }
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+    cacheX_set(sock, "key_1", "old");
+    cacheX_set(sock, "other", "kept");
+    std::string value;
+    uint64_t version = 0;
+    cacheX_get_versioned(sock, "key_1", value, version);
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    int64_t loaded = cacheX_bulkload(sock, BULK_PATH);
+    gettimeofday(&end, NULL);
+    double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+    printf("BULKLOAD of %d keys took %.1f ms\n", NUM_KEYS, ms);
+    if (loaded != NUM_KEYS + 1 || keys(sock) != NUM_KEYS + 1) {
+        return fail("BULKLOAD count");
+    }
+
+    uint64_t loaded_version = 0;
+    if (cacheX_get_versioned(sock, "key_1", value, loaded_version) != 0 || value != "value_1" ||
+        loaded_version <= version) {
+        return fail("existing key replaced with a new version");
+    }
+    if (cacheX_get(sock, "key_7") != "last" || cacheX_get(sock, "other") != "kept") {
+        return fail("duplicate and unrelated keys");
+    }
+    for (int i = 0; i < NUM_KEYS; i += 997) {
+        Response response;
+        send_request(sock, {"GET", "key_" + std::to_string(i)});
+        read_response(sock, response);
+        if (i != 7 && std::string(response.data.begin(), response.data.end()) != value_for(i)) {
+            return fail("loaded value");
+        }
+    }
+
+    // A truncated or corrupt file is rejected as a whole, and a missing one is an error too
+    std::vector<uint8_t> data;
+    FILE *fp = fopen(BULK_PATH, "rb");
+    uint8_t chunk[64 * 1024];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), fp)) > 0;) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(fp);
+    std::vector<BulkChunk> chunks;
+    uint64_t end_offset = 0;
+    if (bulk_read_index(data.data(), data.size(), chunks, end_offset) < 0) {
+        return fail("bulk_read_index");
+    }
+    cacheX_set(sock, "key_1", "after");
+    fp = fopen(BAD_PATH, "wb");
+    fwrite(data.data(), 1, data.size() / 2, fp);
+    fclose(fp);
+    if (cacheX_bulkload(sock, BAD_PATH) != -1) {
+        return fail("truncated file accepted");
+    }
+    data[chunks.back().offset] = 0x7F;  // not a record type
+    fp = fopen(BAD_PATH, "wb");
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    if (cacheX_bulkload(sock, BAD_PATH) != -1 || cacheX_bulkload(sock, "/nonexistent") != -1) {
+        return fail("malformed file accepted");
+    }
+    // The bad value comes in the last chunk, after the others would have been loaded. Sparse
+    // items out of range would index past the registers once loaded.
+    const std::vector<std::vector<uint8_t>> bad_hlls = {
+        {1},                                   // dense without its registers
+        sparse_hll({kHllRegisters << 8 | 1}),  // index out of range
+        sparse_hll({0xFFFFFF00u | 1}),         // index far out of range
+        sparse_hll({5 << 8 | 0}),              // rank 0
+        sparse_hll({5 << 8 | (kHllQ + 2)}),    // rank no hash can produce
+        sparse_hll({7 << 8 | 1, 5 << 8 | 1}),  // out of order
+        sparse_hll({5 << 8 | 1, 5 << 8 | 2}),  // repeated index
+    };
+    for (const std::vector<uint8_t> &hll : bad_hlls) {
+        if (!write_bad_value(BAD_PATH, hll) || cacheX_bulkload(sock, BAD_PATH) != -1) {
+            return fail("file with an undecodable value accepted");
+        }
+    }
+    std::vector<uint8_t> dense(1 + kHllDenseSize, 0);
+    dense[0] = 1;
+    hll_dense_set(dense.data() + 1, 100, kHllQ + 2);
+    if (!write_bad_value(BAD_PATH, dense) || cacheX_bulkload(sock, BAD_PATH) != -1) {
+        return fail("dense sketch with an impossible register accepted");
+    }
+    if (cacheX_get(sock, "key_1") != "after" || keys(sock) != NUM_KEYS + 1) {
+        return fail("keyspace changed by a rejected file");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    pid_t pid = spawn_server(TEST_PORT);
+    int rv = run();
+    stop_server(pid);
+    unlink(BULK_PATH);
+    unlink(BAD_PATH);
+    if (rv == 0) {
+        printf("[PASS] bulk load\n");
+    }
+    return rv;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17361
+#define NUM_CLIENTS 4
+#define INCREMENTS 100
+
+static int run_conditions(int sock) {
+    int64_t v1 = cacheX_set_if(sock, "k", "a", CACHEX_SET_NX);
+    if (v1 <= 0 || cacheX_set_if(sock, "k", "b", CACHEX_SET_NX) != 0) {
+        return fail("SET NX");
+    }
+    std::string value;
+    uint64_t version = 0;
+    if (cacheX_get_versioned(sock, "k", value, version) != 0 || value != "a" ||
+        version != (uint64_t)v1) {
+        return fail("GET WITHVER");
+    }
+
+    int64_t v2 = cacheX_set_if(sock, "k", "c", CACHEX_SET_IFVER, v1);
+    if (v2 <= v1 || cacheX_set_if(sock, "k", "d", CACHEX_SET_IFVER, v1) != 0 ||
+        cacheX_get(sock, "k") != "c") {
+        return fail("SET IFVER");
+    }
+    if (cacheX_set_if(sock, "missing", "x", CACHEX_SET_XX) != 0 ||
+        cacheX_set_if(sock, "missing", "x", CACHEX_SET_IFVER, 0) != 0 ||
+        cacheX_get_versioned(sock, "missing", value, version) != 1) {
+        return fail("conditions on a missing key");
+    }
+    if (cacheX_set_if(sock, "k", "e", CACHEX_SET_XX) <= v2) {
+        return fail("SET XX");
+    }
+
+    // A plain SET also moves the version, so an old token no longer matches
+    cacheX_get_versioned(sock, "k", value, version);
+    cacheX_set(sock, "k", "f");
+    if (cacheX_set_if(sock, "k", "g", CACHEX_SET_IFVER, version) != 0) {
+        return fail("version after plain SET");
+    }
+
+    // Deleting and recreating a key never brings an old version back
+    cacheX_get_versioned(sock, "k", value, version);
+    cacheX_set(sock, "k", "h");
+    uint64_t recreated = 0;
+    cacheX_get_versioned(sock, "k", value, recreated);
+    if (recreated <= version) {
+        return fail("version after recreate");
+    }
+
+    std::string old;
+    if (cacheX_getset(sock, "gs", "1", old) != 1 || cacheX_getset(sock, "gs", "2", old) != 0 ||
+        old != "1" || cacheX_get(sock, "gs") != "2") {
+        return fail("GETSET");
+    }
+    cacheX_hset(sock, "hash", {{"f", "v"}});
+    if (cacheX_getset(sock, "hash", "x", old) != -1 ||
+        cacheX_get_versioned(sock, "hash", value, version) != -1) {
+        return fail("wrong type");
+    }
+    return 0;
+}
+
+// Clients race to increment one counter with read-modify-write; every lost race retries
+static int run_contention(std::vector<int> &socks) {
+    cacheX_set(socks[0], "counter", "0");
+    int done[NUM_CLIENTS] = {}, conflicts = 0;
+    bool busy = true;
+    while (busy) {
+        busy = false;
+        // Every client reads before any of them writes, so all but one write must fail
+        std::vector<std::string> values(socks.size());
+        std::vector<uint64_t> versions(socks.size());
+        for (size_t i = 0; i < socks.size(); i++) {
+            cacheX_get_versioned(socks[i], "counter", values[i], versions[i]);
+        }
+        int winners = 0;
+        for (size_t i = 0; i < socks.size(); i++) {
+            if (done[i] == INCREMENTS) {
+                continue;
+            }
+            busy = true;
+            std::string next = std::to_string(atoi(values[i].c_str()) + 1);
+            if (cacheX_set_if(socks[i], "counter", next, CACHEX_SET_IFVER, versions[i]) > 0) {
+                done[i]++;
+                winners++;
+            } else {
+                conflicts++;
+            }
+        }
+        if (busy && winners != 1) {
+            return fail("exactly one writer wins each round");
+        }
+    }
+    if (cacheX_get(socks[0], "counter") != std::to_string(NUM_CLIENTS * INCREMENTS) ||
+        conflicts == 0) {
+        return fail("contended increments");
+    }
+    return 0;
+}
+
+int main() {
+    pid_t pid = spawn_server(TEST_PORT);
+    std::vector<int> socks;
+    for (int i = 0; i < NUM_CLIENTS; i++) {
+        socks.push_back(cacheX_connect("127.0.0.1", TEST_PORT));
+    }
+    int rv = run_conditions(socks[0]);
+    if (rv == 0) {
+        rv = run_contention(socks);
+    }
+    for (int sock : socks) {
+        cacheX_close(sock);
+    }
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] cas\n");
+    }
+    return rv;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cacheX_cluster.hpp"
+#include "server_fixture.hpp"
+
+#define BASE_PORT 17301
+#define NUM_NODES 3
+#define NUM_KEYS 2000
+#define BIG_PORT (BASE_PORT + NUM_NODES)
+#define BIG_KEYS 40000
+
+static int run(std::vector<pid_t> &pids) {
+    std::vector<std::string> addrs;
+    for (int i = 0; i < NUM_NODES; i++) {
+        addrs.push_back("127.0.0.1:" + std::to_string(BASE_PORT + i));
+    }
+
+    CacheXCluster *cluster = cacheX_cluster_connect(addrs);
+    if (!cluster) {
+        return fail("cacheX_cluster_connect");
+    }
+
+    std::vector<std::pair<std::string, std::string>> kvs;
+    std::vector<std::string> keys;
+    for (int i = 0; i < NUM_KEYS; i++) {
+        kvs.emplace_back("key_" + std::to_string(i), "value_" + std::to_string(i));
+        keys.push_back(kvs.back().first);
+    }
+    if (cacheX_cluster_mset(cluster, kvs) < 0) {
+        return fail("mset");
+    }
+
+    std::vector<std::string> values;
+    if (cacheX_cluster_mget(cluster, keys, values) < 0 || values.size() != keys.size()) {
+        return fail("mget");
+    }
+    int per_node[NUM_NODES] = {};
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (values[i] != kvs[i].second) {
+            return fail("mget returned a wrong value");
+        }
+        per_node[cacheX_cluster_node_for(cluster, keys[i])]++;
+    }
+
+    // Virtual nodes should keep every node within a reasonable band around the mean
+    for (int n = 0; n < NUM_NODES; n++) {
+        printf("node %d owns %d keys\n", n, per_node[n]);
+        if (per_node[n] < NUM_KEYS / NUM_NODES / 2) {
+            return fail("uneven key distribution");
+        }
+    }
+
+    if (cacheX_cluster_del(cluster, keys[0]) < 0 || cacheX_cluster_get(cluster, keys[0]) != "") {
+        return fail("del");
+    }
+
+    // Take one node down: its keys move to the ring successor, everything else stays put
+    stop_server(pids[1]);
+
+    if (cacheX_cluster_mset(cluster, kvs) < 0) {
+        return fail("mset after node failure");
+    }
+    if (cacheX_cluster_mget(cluster, keys, values) < 0) {
+        return fail("mget after node failure");
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (values[i] != kvs[i].second) {
+            return fail("mget after node failure returned a wrong value");
+        }
+        if (cacheX_cluster_node_for(cluster, keys[i]) == 1) {
+            return fail("key routed to a dead node");
+        }
+    }
+    if (cacheX_cluster_set(cluster, "single", "v") < 0 ||
+        cacheX_cluster_get(cluster, "single") != "v") {
+        return fail("set/get after node failure");
+    }
+
+    cacheX_cluster_close(cluster);
+    return 0;
+}
+
+// A batch whose requests and replies are each far larger than the socket buffers plus the
+// server's --output-limit: the server stops reading until its replies are read, so the client
+// must read while it is still writing
+static int big_batch() {
+    CacheXCluster *cluster = cacheX_cluster_connect({"127.0.0.1:" + std::to_string(BIG_PORT)});
+    if (!cluster) {
+        return fail("cacheX_cluster_connect");
+    }
+    std::vector<std::pair<std::string, std::string>> kvs;
+    std::vector<std::string> keys;
+    for (int i = 0; i < BIG_KEYS; i++) {
+        kvs.emplace_back(std::string(500, 'k') + std::to_string(i),
+                         std::string(500, 'v') + std::to_string(i));
+        keys.push_back(kvs.back().first);
+    }
+    if (cacheX_cluster_mset(cluster, kvs) < 0) {
+        return fail("mset of a large batch");
+    }
+    std::vector<std::string> values;
+    if (cacheX_cluster_mget(cluster, keys, values) < 0 || values.size() != keys.size()) {
+        return fail("mget of a large batch");
+    }
+    for (int i = 0; i < BIG_KEYS; i++) {
+        if (values[i] != kvs[i].second) {
+            return fail("mget of a large batch returned a wrong value");
+        }
+    }
+    cacheX_cluster_close(cluster);
+    return 0;
+}
+
+int main() {
+    std::vector<pid_t> pids;
+    for (int i = 0; i < NUM_NODES; i++) {
+        pids.push_back(spawn_server(BASE_PORT + i));
+    }
+
+    ServerOptions opts;
+    opts.port = BIG_PORT;
+    opts.output_limit = 1 << 20;
+    pids.push_back(spawn_server(opts));
+
+    int rv = run(pids);
+    if (rv == 0) {
+        rv = big_batch();
+    }
+
+    for (pid_t pid : pids) {
+        stop_server(pid);
+    }
+    if (rv == 0) {
+        printf("[PASS] cluster\n");
+    }
+    return rv;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17351
+#define SPIN_US 2000
+
+static int run() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+
+    // Back-to-back requests arrive within the spin budget; the pauses outlast it
+    for (int i = 0; i < 50; i++) {
+        cacheX_set(sock, "key", std::to_string(i));
+    }
+    for (int i = 0; i < 3; i++) {
+        usleep(20 * 1000);
+        cacheX_set(sock, "key", "idle");
+    }
+
+    std::vector<std::pair<std::string, std::string>> fields;
+    if (cacheX_info(sock, fields) < 0) {
+        return fail("INFO");
+    }
+    std::map<std::string, uint64_t> info;
+    for (const auto &field : fields) {
+        info[field.first] = strtoull(field.second.c_str(), nullptr, 10);
+    }
+    if (info["loop_iterations"] == 0 || info["loop_events"] < 53 || info["loop_busy_us"] == 0 ||
+        info["loop_utilization_pct"] > 100 || info["keys"] != 1 || info["connections"] != 1) {
+        return fail("loop counters");
+    }
+    if (info["spin_hits"] == 0 || info["spin_misses"] == 0 || info["loop_spin_us"] == 0) {
+        return fail("spin counters");
+    }
+    // Every miss halves the budget, down to an eighth of the configured value
+    if (info["spin_budget_us"] < SPIN_US / 8 || info["spin_budget_us"] > SPIN_US) {
+        return fail("spin budget");
+    }
+    if (info["cpu"] != 0) {
+        return fail("cpu");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.cpu = 0;
+    opts.spin_us = SPIN_US;
+    pid_t pid = spawn_server(opts);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] event loop\n");
+    }
+    return rv;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17421
+#define NUM_REQUESTS 20000
+#define OUTPUT_LIMIT_MB 1
+#define EMPTY_FRAME_SETS 24
+
+static std::map<std::string, uint64_t> info(int sock) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::map<std::string, uint64_t> out;
+    cacheX_info(sock, fields);
+    for (const auto &field : fields) {
+        out[field.first] = strtoull(field.second.c_str(), nullptr, 10);
+    }
+    return out;
+}
+
+static double now_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// A batch of exactly one read buffer (64 KiB) of SETs followed by an empty frame, queued while
+// the server is stopped. The batch is over the turn budget, so the frame is read on its own by
+// a turn off the run queue, after it served the rest of the batch and with no socket event to
+// follow. Dropping the frame must not drop that turn's replies.
+static int test_empty_frame(pid_t server) {
+    int client = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (client < 0) {
+        return fail("connect");
+    }
+    struct timeval timeout = {5, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // Each SET is 26 bytes of framing and key plus its value
+    std::string value(64 * 1024 / EMPTY_FRAME_SETS - 26, 'e');
+    std::string first = value + std::string(64 * 1024 % EMPTY_FRAME_SETS, 'e');
+    std::vector<uint8_t> batch;
+    for (int i = 0; i < EMPTY_FRAME_SETS; i++) {
+        encode_request(batch, {"SET", "e" + std::to_string(10 + i), i == 0 ? first : value});
+    }
+    batch.resize(batch.size() + kHeaderSize);  // the empty frame
+    kill(server, SIGSTOP);
+    int rv = write_all(client, batch.data(), batch.size());
+    kill(server, SIGCONT);
+    if (rv < 0 || batch.size() != 64 * 1024 + kHeaderSize) {
+        return fail("send the batch");
+    }
+    for (int i = 0; i < EMPTY_FRAME_SETS; i++) {
+        Response response;
+        if (read_response(client, response) < 0 || response.status != RES_OK) {
+            return fail("reply missing after an empty frame");
+        }
+    }
+    if (cacheX_get(client, "e11") != value) {
+        return fail("GET after an empty frame");
+    }
+    cacheX_close(client);
+    return 0;
+}
+
+// One client pipelines a large batch of GETs and doesn't read the replies for a while. The
+// server must keep serving another client meanwhile, hold back the batch at --output-limit
+// instead of buffering all of its replies, and still answer every request in order.
+static int run(pid_t server) {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    int noisy = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0 || noisy < 0) {
+        return fail("connect");
+    }
+    if (test_empty_frame(server) != 0) {
+        return 1;
+    }
+    int rcvbuf = 64 * 1024;  // so the replies back up in the server soon
+    setsockopt(noisy, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    std::string value(1000, 'v');
+    cacheX_set(sock, "big", value);
+
+    std::vector<uint8_t> batch;
+    for (int i = 0; i < NUM_REQUESTS; i++) {
+        encode_request(batch, {"GET", i % 2 ? "big" : "missing"});
+    }
+    // The replies (about 10 MB) are not read until the batch is sent, so the send blocks once
+    // the server stops reading; it runs on its own thread
+    std::thread sender([&] { write_all(noisy, batch.data(), batch.size()); });
+    auto bail = [&](const char *what) {
+        shutdown(noisy, SHUT_RDWR);
+        sender.join();
+        return fail(what);
+    };
+
+    // Once the kernel buffers are full the replies pile up in the server, up to the limit
+    bool paused = false;
+    for (int i = 0; i < 1000 && !paused; i++) {
+        usleep(10 * 1000);
+        paused = info(sock)["output_pauses"] > 0;
+    }
+    if (!paused) {
+        return bail("the pipeline was not held back at the output limit");
+    }
+    double worst = 0;
+    for (int i = 0; i < 100; i++) {
+        double start = now_ms();
+        if (cacheX_get(sock, "big") != value) {
+            return bail("GET while another client pipelines");
+        }
+        worst = std::max(worst, now_ms() - start);
+    }
+    printf("slowest GET next to a %d request pipeline: %.2f ms\n", NUM_REQUESTS, worst);
+    if (info(sock)["sched_yields"] == 0) {
+        return bail("the pipeline was served in one turn");
+    }
+
+    for (int i = 0; i < NUM_REQUESTS; i++) {
+        Response response;
+        if (read_response(noisy, response) < 0) {
+            return bail("pipelined reply missing");
+        }
+        bool hit = i % 2;
+        if (response.status != (hit ? RES_OK : RES_NX) ||
+            (hit && std::string(response.data.begin(), response.data.end()) != value)) {
+            return bail("pipelined reply out of order");
+        }
+    }
+    sender.join();
+    if (info(sock)["run_queue"] != 0) {
+        return fail("run queue not empty when idle");
+    }
+    cacheX_close(noisy);
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.turn_requests = 16;
+    opts.output_limit = OUTPUT_LIMIT_MB << 20;
+    pid_t pid = spawn_server(opts);
+    int rv = run(pid);
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] fair scheduling\n");
+    }
+    return rv;
+}
@@ -0,0 +1,312 @@
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+#include "snapshot.hpp"
+
+#define TEST_PORT 17341
+#define HANDOFF_PATH "/tmp/cacheX_test_handoff.sock"
+#define V1_PORT 17342
+#define V1_PATH "/tmp/cacheX_test_handoff_v1.sock"
+#define PENDING_PORT 17343
+#define PENDING_PATH "/tmp/cacheX_test_handoff_pending.sock"
+#define PENDING_REQUESTS 8000
+#define NUM_KEYS 2000
+
+// The old process exits on its own once the new one has taken over
+static bool wait_exit(pid_t pid) {
+    for (int i = 0; i < 1000; i++) {
+        if (waitpid(pid, nullptr, WNOHANG) == pid) {
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    stop_server(pid);
+    return false;
+}
+
+static std::string value_for(int i) { return std::string(1000, 'a' + i % 26) + std::to_string(i); }
+
+// cacheX_get() dumps every reply, which is slow for this many large values
+static std::string quiet_get(int sock, const std::string &key) {
+    Response response;
+    if (send_request(sock, {"GET", key}) < 0 || read_response(sock, response) < 0) {
+        return "";
+    }
+    return std::string(response.data.begin(), response.data.end());
+}
+
+static int populate() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+    // About 2 MB of strings, so the stream spans several writes
+    for (int i = 0; i < NUM_KEYS; i++) {
+        cacheX_set(sock, "key_" + std::to_string(i), value_for(i));
+    }
+    std::vector<std::string> elements;
+    for (int i = 0; i < 5000; i++) {
+        elements.push_back("e" + std::to_string(i));
+    }
+    cacheX_pfadd(sock, "hll_dense", elements);
+    cacheX_pfadd(sock, "hll_sparse", {"x", "y", "z"});
+    cacheX_hset(sock, "hash_small", {{"f1", "v1"}, {"f2", "v2"}});
+    cacheX_hset(sock, "hash_big", {{"f", std::string(100, 'v')}});
+    cacheX_close(sock);
+    return 0;
+}
+
+static int verify(int64_t dense_count, uint64_t &version) {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect after handoff");
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (quiet_get(sock, "key_" + std::to_string(i)) != value_for(i)) {
+            return fail("string value after handoff");
+        }
+    }
+    if (cacheX_pfcount(sock, {"hll_dense"}) != dense_count ||
+        cacheX_pfcount(sock, {"hll_sparse"}) != 3) {
+        return fail("HyperLogLog after handoff");
+    }
+    if (cacheX_hget(sock, "hash_small", "f2") != "v2" ||
+        cacheX_hget(sock, "hash_big", "f") != std::string(100, 'v')) {
+        return fail("hash after handoff");
+    }
+    // CAS tokens taken before the handoff stay valid
+    int64_t next = cacheX_set_if(sock, "key_1", value_for(1), CACHEX_SET_IFVER, version);
+    if (next <= (int64_t)version) {
+        return fail("version after handoff");
+    }
+    version = next;
+    cacheX_close(sock);
+    return 0;
+}
+
+static int run(ServerOptions &opts, pid_t *pid) {
+    if (populate() != 0) {
+        return 1;
+    }
+    int old_client = cacheX_connect("127.0.0.1", TEST_PORT);
+    int64_t dense_count = cacheX_pfcount(old_client, {"hll_dense"});
+    std::string value;
+    uint64_t version = 0;
+    cacheX_get_versioned(old_client, "key_1", value, version);
+
+    pid_t next = spawn_server(opts);
+    bool exited = wait_exit(*pid);
+    *pid = next;
+    if (!exited) {
+        return fail("old server did not exit after the handoff");
+    }
+
+    // Connections to the old process are closed; new ones reach the new process
+    Response response;
+    if (send_request(old_client, {"GET", "key_0"}) == 0 &&
+        read_response(old_client, response) == 0) {
+        return fail("old connection still served");
+    }
+    cacheX_close(old_client);
+    if (verify(dense_count, version) != 0) {
+        return 1;
+    }
+
+    // The new process accepts the next upgrade in turn
+    next = spawn_server(opts);
+    exited = wait_exit(*pid);
+    *pid = next;
+    if (!exited) {
+        return fail("second handoff");
+    }
+    return verify(dense_count, version);
+}
+
+// Stand in for a server from before per-entry versions: pass a listening socket and stream a
+// version 1 snapshot, whose records have no version field
+static int v1_stream() {
+    int tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);  // as the server makes it
+    int unix_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in in_addr = {};
+    in_addr.sin_family = AF_INET;
+    in_addr.sin_port = htons(V1_PORT);
+    struct sockaddr_un un_addr = {};
+    un_addr.sun_family = AF_UNIX;
+    strcpy(un_addr.sun_path, V1_PATH);
+    unlink(V1_PATH);
+    if (bind(tcp_fd, (struct sockaddr *)&in_addr, sizeof(in_addr)) < 0 || listen(tcp_fd, 16) < 0 ||
+        bind(unix_fd, (struct sockaddr *)&un_addr, sizeof(un_addr)) < 0 || listen(unix_fd, 1) < 0) {
+        return fail("listen as a version 1 server");
+    }
+
+    ServerOptions opts;
+    opts.port = V1_PORT;
+    opts.handoff_path = V1_PATH;
+    pid_t pid = spawn_server(opts);
+    int sock = accept(unix_fd, nullptr, nullptr);
+    uint32_t kinds = 1;  // the TCP listener only
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct iovec iov = {&kinds, sizeof(kinds)};
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &tcp_fd, sizeof(int));
+    if (sock < 0 || sendmsg(sock, &mh, 0) != (ssize_t)sizeof(kinds)) {
+        stop_server(pid);
+        return fail("send the listener");
+    }
+
+    std::vector<uint8_t> stream(kSnapshotMagic, kSnapshotMagic + 4);
+    uint32_t version = 1;
+    buffer_append(stream, (const uint8_t *)&version, 4);
+    for (int i = 0; i < 3; i++) {
+        std::string key = "v1_" + std::to_string(i), value = "old_" + std::to_string(i);
+        uint32_t klen = key.size(), vlen = value.size();
+        stream.push_back(REC_STR);
+        buffer_append(stream, (const uint8_t *)&klen, 4);
+        buffer_append(stream, (const uint8_t *)key.data(), klen);
+        buffer_append(stream, (const uint8_t *)&vlen, 4);
+        buffer_append(stream, (const uint8_t *)value.data(), vlen);
+    }
+    snapshot_put_end(stream);
+    write_all(sock, stream.data(), stream.size());
+    close(sock);
+    close(unix_fd);
+    close(tcp_fd);
+
+    int rv = 0;
+    int client = cacheX_connect("127.0.0.1", V1_PORT);
+    std::vector<uint64_t> versions;
+    for (int i = 0; i < 3 && rv == 0; i++) {
+        std::string value;
+        uint64_t ver = 0;
+        if (cacheX_get_versioned(client, "v1_" + std::to_string(i), value, ver) != 0 ||
+            value != "old_" + std::to_string(i)) {
+            rv = fail("value from a version 1 snapshot");
+        }
+        for (uint64_t seen : versions) {
+            if (ver == 0 || ver == seen) {
+                rv = fail("entries from a version 1 snapshot share a version");
+            }
+        }
+        versions.push_back(ver);
+    }
+    if (rv == 0 && cacheX_set_if(client, "v1_0", "new", CACHEX_SET_IFVER, versions[0]) <= 0) {
+        rv = fail("CAS on an entry from a version 1 snapshot");
+    }
+    cacheX_close(client);
+    stop_server(pid);
+    unlink(V1_PATH);
+    return rv;
+}
+
+static uint64_t output_pauses(int sock) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    cacheX_info(sock, fields);
+    for (const auto &field : fields) {
+        if (field.first == "output_pauses") {
+            return strtoull(field.second.c_str(), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+// Requests the old process has read but not run when it hands off are answered with RES_ERR,
+// not dropped. Here a client pipelines GETs without reading the replies, so most of them wait
+// at the output limit when the handoff comes.
+static int pending_requests() {
+    ServerOptions opts;
+    opts.port = PENDING_PORT;
+    opts.handoff_path = PENDING_PATH;
+    opts.output_limit = 1 << 20;
+    unlink(PENDING_PATH);
+    pid_t old_pid = spawn_server(opts);
+    int control = cacheX_connect("127.0.0.1", PENDING_PORT);
+    int noisy = cacheX_connect("127.0.0.1", PENDING_PORT);
+    int rcvbuf = 64 * 1024;  // so the replies back up in the server soon
+    setsockopt(noisy, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    std::string value(1000, 'v');
+    cacheX_set(control, "big", value);
+    std::vector<uint8_t> batch;
+    for (int i = 0; i < PENDING_REQUESTS; i++) {
+        encode_request(batch, {"GET", "big"});
+    }
+    std::thread sender([&] { write_all(noisy, batch.data(), batch.size()); });
+    for (int i = 0; i < 1000 && output_pauses(control) == 0; i++) {
+        usleep(10 * 1000);
+    }
+
+    // The control connection has nothing pending, so it is closed as soon as the old process
+    // is done with the handoff, and with failing what it had not run
+    pid_t new_pid = spawn_server(opts);
+    char byte;
+    while (recv(control, &byte, 1, 0) > 0) {
+    }
+    int rv = 0;
+    size_t ok = 0, failed = 0;
+    Response response;
+    while (rv == 0 && read_response(noisy, response) == 0) {
+        if (response.status == RES_OK && failed == 0) {
+            ok++;
+        } else if (response.status == RES_ERR) {
+            failed++;
+        } else {
+            rv = fail("reply after a failed request");
+        }
+    }
+    printf("pipelined across the handoff: %zu answered, %zu failed\n", ok, failed);
+    if (rv == 0 && (ok == 0 || failed == 0)) {
+        rv = fail("requests pending at the handoff were not failed");
+    }
+    shutdown(noisy, SHUT_RDWR);
+    sender.join();
+    cacheX_close(noisy);
+    cacheX_close(control);
+    if (!wait_exit(old_pid) && rv == 0) {
+        rv = fail("old server did not exit after the handoff");
+    }
+    stop_server(new_pid);
+    unlink(PENDING_PATH);
+    return rv;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.handoff_path = HANDOFF_PATH;
+    unlink(HANDOFF_PATH);
+
+    pid_t pid = spawn_server(opts);
+    int rv = run(opts, &pid);
+    stop_server(pid);
+    unlink(HANDOFF_PATH);
+    if (rv == 0) {
+        rv = v1_stream();
+    }
+    if (rv == 0) {
+        rv = pending_requests();
+    }
+    if (rv == 0) {
+        printf("[PASS] handoff\n");
+    }
+    return rv;
+}
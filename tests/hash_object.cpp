@@ -0,0 +1,90 @@
+#include <stdio.h>
+
+#include <map>
+#include <string>
+
+#include "hash_object.hpp"
+
+static int fail(const char *what) {
+    fprintf(stderr, "[FAIL] %s\n", what);
+    return 1;
+}
+
+// Compare the object against a reference map through every read path
+static bool matches(HashObject &h, const std::map<std::string, std::string> &ref) {
+    if (hash_size(h) != ref.size()) {
+        return false;
+    }
+    std::string value;
+    for (const auto &fv : ref) {
+        if (!hash_get(h, fv.first, value) || value != fv.second) {
+            return false;
+        }
+    }
+    size_t seen = 0;
+    bool ok = true;
+    hash_foreach(h, [&](const std::string &field, const std::string &value) {
+        auto it = ref.find(field);
+        ok = ok && it != ref.end() && it->second == value;
+        seen++;
+    });
+    return ok && seen == ref.size();
+}
+
+int main() {
+    HashObject h;
+    std::map<std::string, std::string> ref;
+
+    // Small hashes stay packed, including in-place updates and deletes
+    for (int i = 0; i < 10; i++) {
+        std::string f = "f" + std::to_string(i);
+        if (!hash_set(h, f, "v" + std::to_string(i))) {
+            return fail("new field reported as existing");
+        }
+        ref[f] = "v" + std::to_string(i);
+    }
+    if (hash_set(h, "f3", "updated")) {
+        return fail("update reported as new field");
+    }
+    ref["f3"] = "updated";
+    if (!hash_del(h, "f5") || hash_del(h, "f5")) {
+        return fail("packed delete");
+    }
+    ref.erase("f5");
+    if (!h.packed || !matches(h, ref)) {
+        return fail("packed contents");
+    }
+
+    // A long value converts to the table form transparently
+    hash_set(h, "big", std::string(kHashPackedMaxLen + 1, 'x'));
+    ref["big"] = std::string(kHashPackedMaxLen + 1, 'x');
+    if (h.packed || !matches(h, ref)) {
+        return fail("conversion on long value");
+    }
+    if (!hash_del(h, "f0") || hash_get(h, "f0", ref["unused"])) {
+        return fail("table delete");
+    }
+    ref.erase("f0");
+    ref.erase("unused");
+    if (!matches(h, ref)) {
+        return fail("table contents");
+    }
+    hash_clear(h);
+
+    // So does growing past the field limit
+    ref.clear();
+    for (size_t i = 0; i <= kHashPackedMaxFields; i++) {
+        hash_set(h, "field:" + std::to_string(i), std::to_string(i));
+        ref["field:" + std::to_string(i)] = std::to_string(i);
+    }
+    if (h.packed || !matches(h, ref)) {
+        return fail("conversion on field count");
+    }
+    hash_clear(h);
+    if (!h.packed || hash_size(h) != 0) {
+        return fail("clear");
+    }
+
+    printf("[PASS] hash object\n");
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17431
+#define ROUNDS 20000
+#define SAMPLE 2
+
+static uint64_t rate_of(const std::vector<std::pair<std::string, uint64_t>> &top,
+                        const std::string &key) {
+    for (const auto &item : top) {
+        if (item.first == key) {
+            return item.second;
+        }
+    }
+    return 0;
+}
+
+// A skewed workload where reads and writes strictly alternate: every round reads hot_r and
+// writes hot_w, and every fourth round also reads and writes a key of its own. With 1 in 2
+// accesses sampled, both trackers must still see their hot key at the same rate.
+static int run() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+    std::vector<uint8_t> batch;
+    size_t nreq = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        encode_request(batch, {"GET", "hot_r"});
+        encode_request(batch, {"SET", "hot_w", "v"});
+        nreq += 2;
+        if (i % 4 == 0) {
+            std::string cold = "cold_" + std::to_string(i);
+            encode_request(batch, {"GET", cold});
+            encode_request(batch, {"SET", cold, "v"});
+            nreq += 2;
+        }
+    }
+    // The replies are small enough to read after the whole batch is sent
+    if (write_all(sock, batch.data(), batch.size()) < 0) {
+        return fail("send the workload");
+    }
+    for (size_t i = 0; i < nreq; i++) {
+        Response response;
+        if (read_response(sock, response) < 0) {
+            return fail("reply missing");
+        }
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> reads, writes;
+    if (cacheX_hotkeys(sock, false, 5, reads) < 0 || cacheX_hotkeys(sock, true, 5, writes) < 0) {
+        return fail("HOTKEYS");
+    }
+    if (reads.empty() || reads[0].first != "hot_r") {
+        return fail("hottest read key");
+    }
+    if (writes.empty() || writes[0].first != "hot_w") {
+        return fail("hottest write key");
+    }
+    // Both hot keys saw the same number of accesses at the same time, and a cold key at most a
+    // couple of samples
+    uint64_t r = rate_of(reads, "hot_r"), w = rate_of(writes, "hot_w");
+    printf("estimated ops/sec: hot_r %llu, hot_w %llu\n", (unsigned long long)r,
+           (unsigned long long)w);
+    if (r > 2 * w || w > 2 * r) {
+        return fail("read and write rates of equally hot keys differ");
+    }
+    if (reads.size() > 1 && reads[1].second * 10 > r) {
+        return fail("cold key estimated close to the hot one");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.hotkey_sample = SAMPLE;
+    pid_t pid = spawn_server(opts);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] hot keys\n");
+    }
+    return rv;
+}
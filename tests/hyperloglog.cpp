@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "hyperloglog.hpp"
+
+static int fail(const char *what, uint64_t got, uint64_t want) {
+    fprintf(stderr, "[FAIL] %s: got %lu, want ~%lu\n", what, (unsigned long)got,
+            (unsigned long)want);
+    return 1;
+}
+
+static void add_range(HyperLogLog &hll, int from, int to) {
+    for (int i = from; i < to; i++) {
+        std::string item = "user:" + std::to_string(i);
+        hll_add(hll, reinterpret_cast<const uint8_t *>(item.data()), item.size());
+    }
+}
+
+// Standard error for 16384 registers is 0.81%; allow a bit over three sigma
+static bool close_enough(uint64_t got, uint64_t want) {
+    double err = (double)got - (double)want;
+    return (err < 0 ? -err : err) <= want * 0.025 + 1;
+}
+
+int main() {
+    HyperLogLog hll;
+    add_range(hll, 0, 100);
+    if (hll.dense || !close_enough(hll_count(hll), 100)) {
+        return fail("sparse estimate", hll_count(hll), 100);
+    }
+    // Re-adding the same elements changes nothing
+    std::string again = "user:7";
+    if (hll_add(hll, reinterpret_cast<const uint8_t *>(again.data()), again.size())) {
+        return fail("duplicate add changed a register", 1, 0);
+    }
+
+    add_range(hll, 100, 200000);
+    if (!hll.dense || hll.regs.size() != kHllDenseSize) {
+        return fail("dense conversion", hll.regs.size(), kHllDenseSize);
+    }
+    if (!close_enough(hll_count(hll), 200000)) {
+        return fail("dense estimate", hll_count(hll), 200000);
+    }
+
+    // Packing round trip and single-register access agree
+    std::vector<uint8_t> regs(kHllRegisters), packed(kHllDenseSize);
+    hll_unpack(hll, regs.data());
+    hll_dense_pack(regs.data(), packed.data());
+    if (packed != hll.regs) {
+        return fail("pack/unpack round trip", 0, 1);
+    }
+    for (uint32_t i = 0; i < kHllRegisters; i++) {
+        if (hll_dense_get(hll.regs.data(), i) != regs[i]) {
+            return fail("dense register access", i, regs[i]);
+        }
+    }
+
+    // Union of two overlapping sets: 150k..300k merged with 0..200k covers 300k elements
+    HyperLogLog other;
+    add_range(other, 150000, 300000);
+    std::vector<uint8_t> acc(kHllRegisters, 0);
+    hll_merge_into(acc.data(), hll);
+    hll_merge_into(acc.data(), other);
+    if (!close_enough(hll_estimate(acc.data()), 300000)) {
+        return fail("merged estimate", hll_estimate(acc.data()), 300000);
+    }
+
+    HyperLogLog merged;
+    hll_load(merged, acc.data());
+    if (!merged.dense || hll_count(merged) != hll_estimate(acc.data())) {
+        return fail("load from registers", hll_count(merged), hll_estimate(acc.data()));
+    }
+
+    printf("[PASS] hyperloglog\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17391
+#define PLAIN_PORT 17392
+#define NUM_KEYS 5000
+
+static void del(int sock, const std::string &key) {
+    Response response;
+    send_request(sock, {"DEL", key});
+    read_response(sock, response);
+}
+
+static int run() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+
+    // Random inserts and deletes, mirrored in a std::set
+    std::set<std::string> expected;
+    std::mt19937 rng(1);
+    for (int i = 0; i < NUM_KEYS; i++) {
+        std::string key = "user:" + std::to_string(rng() % 1000) + ":s" + std::to_string(i % 3);
+        if (rng() % 4 == 0) {
+            del(sock, key);
+            expected.erase(key);
+        } else {
+            cacheX_set(sock, key, "v");
+            expected.insert(key);
+        }
+    }
+    cacheX_hset(sock, "user:h", {{"f", "v"}});
+    cacheX_hdel(sock, "user:h", {"f"});  // deletes the key with its last field
+
+    std::vector<std::string> keys;
+    if (cacheX_keyrange(sock, "", "", 200000, keys) != 0 ||
+        keys != std::vector<std::string>(expected.begin(), expected.end())) {
+        return fail("KEYRANGE over the whole keyspace");
+    }
+
+    // Page through a prefix, resuming just past the last key of each page
+    std::vector<std::string> want, got;
+    for (const std::string &key : expected) {
+        if (key.compare(0, 7, "user:12") == 0) {
+            want.push_back(key);
+        }
+    }
+    if (cacheX_keyprefix(sock, "user:12", 1000, keys) != 0 || keys != want) {
+        return fail("KEYPREFIX");
+    }
+    std::string start = "user:12";
+    while (cacheX_keyrange(sock, start, "user:13", 3, keys) == 0 && !keys.empty()) {
+        got.insert(got.end(), keys.begin(), keys.end());
+        start = keys.back() + std::string(1, '\0');
+    }
+    if (got != want) {
+        return fail("paged KEYRANGE");
+    }
+    if (cacheX_keyprefix(sock, "nope:", 10, keys) != 0 || !keys.empty()) {
+        return fail("KEYPREFIX without matches");
+    }
+    Response response;
+    send_request(sock, {"KEYPREFIX", "user:", "LIMIT", "x"});
+    read_response(sock, response);
+    if (response.status != RES_ERR) {
+        return fail("bad LIMIT accepted");
+    }
+    cacheX_close(sock);
+
+    // Without --key-index the commands are refused
+    sock = cacheX_connect("127.0.0.1", PLAIN_PORT);
+    if (cacheX_keyprefix(sock, "user:", 10, keys) != -1) {
+        return fail("KEYPREFIX without the index");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.key_index = true;
+    pid_t pid = spawn_server(opts);
+    pid_t plain = spawn_server(PLAIN_PORT);
+    int rv = run();
+    stop_server(pid);
+    stop_server(plain);
+    if (rv == 0) {
+        printf("[PASS] key index\n");
+    }
+    return rv;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cacheX_async.hpp"
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17411
+#define NUM_KEYS 200000
+
+static std::map<std::string, uint64_t> info(int sock) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::map<std::string, uint64_t> out;
+    cacheX_info(sock, fields);
+    for (const auto &field : fields) {
+        out[field.first] = strtoull(field.second.c_str(), nullptr, 10);
+    }
+    return out;
+}
+
+static double now_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static bool drained(int sock) {
+    for (int i = 0; i < 200; i++) {
+        if (info(sock)["lazyfree_pending"] == 0) {
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    return false;
+}
+
+static int fill(int sock, int nkeys) {
+    CacheXAsync *client = cacheX_async_connect("127.0.0.1", TEST_PORT, 4);
+    if (!client) {
+        return fail("cacheX_async_connect");
+    }
+    for (int i = 0; i < nkeys; i++) {
+        cacheX_async_set_quiet(client, "key_" + std::to_string(i), "value_" + std::to_string(i));
+    }
+    cacheX_async_wait(client);
+    cacheX_async_close(client);
+    return info(sock)["keys"] >= (uint64_t)nkeys ? 0 : fail("filling the keyspace");
+}
+
+static int run() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+
+    // Large strings and table-form hashes are freed in the background
+    std::string big(16 << 20, 'x');
+    std::vector<std::pair<std::string, std::string>> fields;
+    for (int i = 0; i < 10000; i++) {
+        fields.emplace_back("f" + std::to_string(i), "v");
+    }
+    cacheX_set(sock, "big1", big);
+    cacheX_set(sock, "big2", big);
+    cacheX_hset(sock, "hash1", fields);
+    cacheX_hset(sock, "hash2", fields);
+    cacheX_set(sock, "small", "v");
+
+    double start = now_ms();
+    Response response;
+    send_request(sock, {"DEL", "big1"});
+    read_response(sock, response);
+    printf("DEL of a 16 MB value took %.2f ms\n", now_ms() - start);
+    if (cacheX_unlink(sock, {"big2", "hash1", "small", "missing"}) != 3) {
+        return fail("UNLINK count");
+    }
+    cacheX_set(sock, "hash2", "now a string");  // the replaced hash goes to the thread too
+    cacheX_set(sock, "big3", big);
+    cacheX_set(sock, "big3", "small again");
+    if (cacheX_get(sock, "big1") != "" || cacheX_get(sock, "hash2") != "now a string" ||
+        cacheX_get(sock, "big3") != "small again" || !drained(sock)) {
+        return fail("lazy DEL, UNLINK and overwrite");
+    }
+
+    // FLUSHALL ASYNC empties the keyspace before it replies, and frees it afterwards
+    if (fill(sock, NUM_KEYS) != 0) {
+        return 1;
+    }
+    start = now_ms();
+    if (cacheX_flushall(sock, true) != 0) {
+        return fail("FLUSHALL ASYNC");
+    }
+    printf("FLUSHALL ASYNC of %d keys took %.2f ms\n", NUM_KEYS, now_ms() - start);
+    if (info(sock)["keys"] != 0 || cacheX_get(sock, "key_1") != "") {
+        return fail("keys left after FLUSHALL ASYNC");
+    }
+    cacheX_set(sock, "key_1", "new");
+    if (cacheX_get(sock, "key_1") != "new" || !drained(sock)) {
+        return fail("keyspace after FLUSHALL ASYNC");
+    }
+
+    if (fill(sock, NUM_KEYS) != 0) {
+        return 1;
+    }
+    start = now_ms();
+    if (cacheX_flushall(sock, false) != 0 || info(sock)["keys"] != 0) {
+        return fail("FLUSHALL");
+    }
+    printf("FLUSHALL of %d keys took %.2f ms\n", NUM_KEYS, now_ms() - start);
+    send_request(sock, {"FLUSHALL", "SOON"});
+    read_response(sock, response);
+    if (response.status != RES_ERR) {
+        return fail("FLUSHALL with a bad argument");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    pid_t pid = spawn_server(TEST_PORT);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] lazy free\n");
+    }
+    return rv;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+
+#include <string>
+
+#include "cacheX_near_cache.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17321
+
+// Invalidations are pushed asynchronously; give the reader a moment to receive them
+static std::string get_after_invalidation(CacheXNearCache *cache, const std::string &key,
+                                          uint64_t invalidations) {
+    for (int i = 0; i < 100 && cacheX_near_cache_stats(cache).invalidations <= invalidations;
+         i++) {
+        cacheX_near_get(cache, "__poll__");
+        usleep(1000);
+    }
+    return cacheX_near_get(cache, key);
+}
+
+static int run() {
+    int reader_sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    int prefix_sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    int writer = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (reader_sock < 0 || prefix_sock < 0 || writer < 0) {
+        return fail("connect");
+    }
+
+    CacheXNearCache *reader = cacheX_near_cache_new(reader_sock, 2);
+    CacheXNearCache *by_prefix = cacheX_near_cache_new(prefix_sock, 16, {"user:"});
+    if (!reader || !by_prefix) {
+        return fail("cacheX_near_cache_new");
+    }
+
+    cacheX_set(writer, "a", "1");
+    if (cacheX_near_get(reader, "a") != "1" || cacheX_near_get(reader, "a") != "1") {
+        return fail("read through");
+    }
+    CacheXNearCacheStats stats = cacheX_near_cache_stats(reader);
+    if (stats.hits != 1 || stats.misses != 1) {
+        return fail("second read should be served locally");
+    }
+
+    // A write from another connection invalidates the local copy
+    cacheX_set(writer, "a", "2");
+    if (get_after_invalidation(reader, "a", stats.invalidations) != "2") {
+        return fail("stale value after SET");
+    }
+
+    // The LRU bound holds: with capacity 2, "a" is evicted by two newer keys
+    cacheX_set(writer, "b", "b");
+    cacheX_set(writer, "c", "c");
+    cacheX_near_get(reader, "b");
+    cacheX_near_get(reader, "c");
+    stats = cacheX_near_cache_stats(reader);
+    cacheX_near_get(reader, "a");
+    if (cacheX_near_cache_stats(reader).misses != stats.misses + 1) {
+        return fail("capacity bound");
+    }
+
+    // Prefix mode caches keys under the prefix and hears about every write to them
+    cacheX_set(writer, "user:1", "alice");
+    if (cacheX_near_get(by_prefix, "user:1") != "alice" ||
+        cacheX_near_get(by_prefix, "user:1") != "alice") {
+        return fail("prefix read through");
+    }
+    stats = cacheX_near_cache_stats(by_prefix);
+    cacheX_set(writer, "user:1", "bob");
+    if (get_after_invalidation(by_prefix, "user:1", stats.invalidations) != "bob") {
+        return fail("stale value in prefix mode");
+    }
+
+    // Writes through the near cache itself are never served stale
+    cacheX_near_set(reader, "b", "b2");
+    if (cacheX_near_get(reader, "b") != "b2") {
+        return fail("write through");
+    }
+    cacheX_near_del(reader, "b");
+    if (cacheX_near_get(reader, "b") != "") {
+        return fail("delete through");
+    }
+
+    cacheX_near_cache_free(reader);
+    cacheX_near_cache_free(by_prefix);
+    cacheX_close(reader_sock);
+    cacheX_close(prefix_sock);
+    cacheX_close(writer);
+    return 0;
+}
+
+int main() {
+    pid_t pid = spawn_server(TEST_PORT);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] near cache\n");
+    }
+    return rv;
+}
@@ -0,0 +1,97 @@
+#include <elf.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Checks that the server binary given on the command line carries the USDT probes listed in
+// include/trace.hpp, by reading its .note.stapsdt section like readelf -n does
+
+static int fail(const char *what, const std::string &detail = "") {
+    fprintf(stderr, "[FAIL] %s %s\n", what, detail.c_str());
+    return 1;
+}
+
+static bool read_file(const char *path, std::vector<char> &data) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+// Probe name to its argument string, e.g. "-4@%edi 8@%rax"
+static bool read_probes(const std::vector<char> &data, std::map<std::string, std::string> &out) {
+    if (data.size() < sizeof(Elf64_Ehdr) || memcmp(data.data(), ELFMAG, SELFMAG) != 0 ||
+        data[EI_CLASS] != ELFCLASS64) {
+        return false;
+    }
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)data.data();
+    if (eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > data.size() ||
+        eh->e_shstrndx >= eh->e_shnum) {
+        return false;
+    }
+    const Elf64_Shdr *sh = (const Elf64_Shdr *)(data.data() + eh->e_shoff);
+    const char *names = data.data() + sh[eh->e_shstrndx].sh_offset;
+    for (size_t i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type != SHT_NOTE || strcmp(names + sh[i].sh_name, ".note.stapsdt") != 0) {
+            continue;
+        }
+        const char *pos = data.data() + sh[i].sh_offset;
+        const char *end = pos + sh[i].sh_size;
+        while (pos + sizeof(Elf64_Nhdr) <= end) {
+            const Elf64_Nhdr *nh = (const Elf64_Nhdr *)pos;
+            const char *owner = pos + sizeof(Elf64_Nhdr);
+            const char *desc = owner + ((nh->n_namesz + 3) & ~3u);
+            pos = desc + ((nh->n_descsz + 3) & ~3u);
+            if (pos > end || nh->n_type != 3 || strcmp(owner, "stapsdt") != 0) {
+                continue;
+            }
+            // Probe address, base address and semaphore, then three strings
+            const char *provider = desc + 3 * sizeof(uint64_t);
+            const char *name = provider + strlen(provider) + 1;
+            const char *args = name + strlen(name) + 1;
+            if (strcmp(provider, "cachex") == 0) {
+                out[name] = args;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::vector<char> data;
+    std::map<std::string, std::string> probes;
+    if (argc < 2 || !read_file(argv[1], data)) {
+        return fail("usage: test_probes <cacheX binary>");
+    }
+    if (!read_probes(data, probes)) {
+        return fail("not a 64-bit ELF file:", argv[1]);
+    }
+    const std::map<std::string, int> want = {
+        {"request_start", 2}, {"request_parsed", 4}, {"request_done", 4}, {"conn_flush", 3}};
+    for (const auto &probe : want) {
+        auto it = probes.find(probe.first);
+        if (it == probes.end()) {
+            return fail("probe missing:", probe.first);
+        }
+        int nargs = 0;
+        for (const char *p = it->second.c_str(); (p = strchr(p, '@')); p++) {
+            nargs++;
+        }
+        if (nargs != probe.second) {
+            return fail("wrong argument count:", probe.first + " " + it->second);
+        }
+        printf("cachex:%s %s\n", it->first.c_str(), it->second.c_str());
+    }
+    printf("[PASS] USDT probes\n");
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "cacheX_async.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17331
+
+// Read one v2 reply frame
+static int read_reply_v2(int sock, V2Header &hdr, Response &out) {
+    uint32_t len = 0;
+    if (read_all(sock, &len, sizeof(len)) < 0 || len < kV2ReplyHeader || len > kMaxPayloadSize) {
+        return -1;
+    }
+    std::vector<uint8_t> body(len);
+    if (read_all(sock, body.data(), len) < 0) {
+        return -1;
+    }
+    return parse_reply_v2(body.data(), len, hdr, out);
+}
+
+static int send_v2(int sock, uint8_t op, uint8_t flags, uint32_t id,
+                   const std::vector<std::string> &cmd) {
+    std::vector<uint8_t> wbuf;
+    if (encode_request_v2(wbuf, op, flags, id, cmd) < 0) {
+        return -1;
+    }
+    return write_all(sock, wbuf.data(), wbuf.size());
+}
+
+static int64_t reply_int(const Response &r) {
+    int64_t val = -1;
+    if (r.type == REPLY_INT && r.data.size() == sizeof(val)) {
+        memcpy(&val, r.data.data(), sizeof(val));
+    }
+    return val;
+}
+
+static int run_wire() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+    if (cacheX_hello(sock, 3) != -1 || cacheX_hello(sock, kProtoV2) != (int)kProtoV2) {
+        return fail("HELLO negotiation");
+    }
+
+    // Quiet SETs produce nothing, so the first frame back is the GET's
+    V2Header hdr;
+    Response r;
+    send_v2(sock, OP_SET, V2_FLAG_QUIET, 0, {"", "k", "v"});
+    send_v2(sock, OP_SET, V2_FLAG_QUIET | V2_FLAG_ID, 1, {"", "n", "x"});
+    send_v2(sock, OP_GET, V2_FLAG_ID, 42, {"", "k"});
+    if (read_reply_v2(sock, hdr, r) < 0 || hdr.id != 42 || r.type != REPLY_STR ||
+        std::string(r.data.begin(), r.data.end()) != "v") {
+        return fail("GET after quiet SET");
+    }
+
+    // Typed replies
+    send_v2(sock, OP_GET, 0, 0, {"", "missing"});
+    if (read_reply_v2(sock, hdr, r) < 0 || r.type != REPLY_NULL || r.status != RES_NX ||
+        (hdr.flags & V2_FLAG_ID)) {
+        return fail("null reply");
+    }
+    send_v2(sock, OP_PFADD, 0, 0, {"", "hll", "a", "b"});
+    if (read_reply_v2(sock, hdr, r) < 0 || reply_int(r) != 1) {
+        return fail("integer reply");
+    }
+    send_v2(sock, OP_HSET, 0, 0, {"", "h", "f", "1"});
+    read_reply_v2(sock, hdr, r);
+    send_v2(sock, OP_HMGET, V2_FLAG_ID, 7, {"", "h", "f", "g"});
+    std::vector<std::string> values;
+    std::vector<bool> found;
+    if (read_reply_v2(sock, hdr, r) < 0 || hdr.id != 7 || r.type != REPLY_ARR ||
+        parse_array(r.data.data(), r.data.size(), values, found) < 0 || values.size() != 2 ||
+        values[0] != "1" || !found[0] || found[1]) {
+        return fail("array reply");
+    }
+
+    // Errors are reported even for quiet requests, with the ID to match them
+    send_v2(sock, OP_MAX, V2_FLAG_QUIET | V2_FLAG_ID, 9, {""});
+    if (read_reply_v2(sock, hdr, r) < 0 || hdr.id != 9 || r.type != REPLY_ERR) {
+        return fail("unknown opcode");
+    }
+    send_v2(sock, OP_GET, V2_FLAG_QUIET | V2_FLAG_ID, 10, {"", "k", "extra"});
+    if (read_reply_v2(sock, hdr, r) < 0 || hdr.id != 10 || r.type != REPLY_ERR) {
+        return fail("wrong arity");
+    }
+
+    // Back to v1: the HELLO reply is still a v2 frame, everything after it is v1
+    send_v2(sock, OP_HELLO, 0, 0, {"", "1"});
+    if (read_reply_v2(sock, hdr, r) < 0 || reply_int(r) != kProtoV1) {
+        return fail("HELLO 1");
+    }
+    if (cacheX_get(sock, "n") != "x") {
+        return fail("v1 after switching back");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+static int run_async() {
+    CacheXAsync *client = cacheX_async_connect("127.0.0.1", TEST_PORT, 2);
+    if (!client) {
+        return fail("cacheX_async_connect");
+    }
+    for (int i = 0; i < 1000; i++) {
+        cacheX_async_set_quiet(client, "quiet_" + std::to_string(i), std::to_string(i));
+    }
+    if (cacheX_async_pending(client) != 1000) {
+        return fail("quiet SETs are pending");
+    }
+    // Nothing follows the quiet SETs, yet the wait covers them
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (cacheX_async_wait(client) < 0 || cacheX_async_pending(client) != 0 ||
+        cacheX_get(sock, "quiet_999") != "999") {
+        return fail("wait for quiet SETs");
+    }
+    cacheX_close(sock);
+    int ok = 0;
+    for (int i = 0; i < 1000; i++) {
+        std::string expected = std::to_string(i);
+        cacheX_async_get(client, "quiet_" + std::to_string(i),
+                         [&ok, expected](int status, const std::string &value) {
+                             ok += status == RES_OK && value == expected;
+                         });
+    }
+    if (cacheX_async_wait(client) < 0 || ok != 1000) {
+        return fail("GET after quiet SETs");
+    }
+    cacheX_async_close(client);
+    return 0;
+}
+
+int main() {
+    pid_t pid = spawn_server(TEST_PORT);
+    int rv = run_wire();
+    if (rv == 0) {
+        rv = run_async();
+    }
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] protocol v2\n");
+    }
+    return rv;
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "cacheX_pubsub.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17401
+#define NUM_SUBSCRIBERS 50
+#define NUM_MESSAGES 100
+#define PUBSUB_LIMIT (1024 * 1024)
+
+static std::map<std::string, uint64_t> info(int sock) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::map<std::string, uint64_t> out;
+    cacheX_info(sock, fields);
+    for (const auto &field : fields) {
+        out[field.first] = strtoull(field.second.c_str(), nullptr, 10);
+    }
+    return out;
+}
+
+static CacheXSubscriber *subscriber(const std::vector<std::string> &channels) {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return nullptr;
+    }
+    CacheXSubscriber *sub = cacheX_subscriber_new(sock);
+    if (cacheX_subscribe(sub, channels) != (int)channels.size()) {
+        cacheX_subscriber_close(sub);
+        return nullptr;
+    }
+    return sub;
+}
+
+// Every subscriber gets every message, in order
+static int fan_out(int sock) {
+    std::vector<CacheXSubscriber *> subs;
+    for (int i = 0; i < NUM_SUBSCRIBERS; i++) {
+        subs.push_back(subscriber({"news", "sub" + std::to_string(i)}));
+        if (!subs.back()) {
+            return fail("SUBSCRIBE");
+        }
+    }
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        if (cacheX_publish(sock, "news", "m" + std::to_string(i)) != NUM_SUBSCRIBERS) {
+            return fail("PUBLISH reach");
+        }
+    }
+    for (CacheXSubscriber *sub : subs) {
+        CacheXMessage msg;
+        for (int i = 0; i < NUM_MESSAGES; i++) {
+            if (cacheX_next_message(sub, msg, 1000) != 1 || msg.channel != "news" ||
+                msg.payload != "m" + std::to_string(i)) {
+                return fail("message order");
+            }
+        }
+        if (cacheX_unsubscribe(sub, {"news"}) != 1 || cacheX_unsubscribe(sub) != 0) {
+            return fail("UNSUBSCRIBE");
+        }
+        cacheX_subscriber_close(sub);
+    }
+    if (cacheX_publish(sock, "news", "nobody") != 0) {
+        return fail("PUBLISH after UNSUBSCRIBE");
+    }
+    return 0;
+}
+
+// SET and DEL are published on __keyspace__:<key>, but only when they write something
+static int keyspace(int sock) {
+    CacheXSubscriber *sub = subscriber({"__keyspace__:k1"});
+    if (!sub) {
+        return fail("SUBSCRIBE to a keyspace channel");
+    }
+    Response response;
+    cacheX_set(sock, "k1", "v");
+    cacheX_set(sock, "k2", "v");
+    cacheX_set_if(sock, "k1", "v", CACHEX_SET_NX);  // not applied
+    send_request(sock, {"DEL", "k1"});
+    read_response(sock, response);
+    send_request(sock, {"DEL", "k1"});  // nothing to delete
+    read_response(sock, response);
+    cacheX_set(sock, "k1", "again");
+
+    const char *expected[] = {"set", "del", "set"};
+    CacheXMessage msg;
+    for (const char *event : expected) {
+        if (cacheX_next_message(sub, msg, 1000) != 1 || msg.payload != event) {
+            return fail("keyspace event");
+        }
+    }
+    if (cacheX_next_message(sub, msg, 100) != 0) {
+        return fail("keyspace event for a write that changed nothing");
+    }
+    cacheX_subscriber_close(sub);
+    return 0;
+}
+
+// Hash and HyperLogLog writes and UNLINK are published too, again only when they change
+// something
+static int keyspace_types(int sock) {
+    CacheXSubscriber *sub = subscriber({"__keyspace__:h1", "__keyspace__:p1"});
+    if (!sub) {
+        return fail("SUBSCRIBE to keyspace channels");
+    }
+    cacheX_hset(sock, "h1", {{"a", "1"}, {"b", "2"}});
+    cacheX_hdel(sock, "h1", {"missing"});  // nothing to remove
+    cacheX_hdel(sock, "h1", {"a"});
+    cacheX_hdel(sock, "h1", {"b"});  // the last field, so the key goes too
+    cacheX_pfadd(sock, "p1", {"x"});
+    cacheX_pfadd(sock, "p1", {"x"});  // no register changes
+    cacheX_pfmerge(sock, "p1", {"p2"});
+    cacheX_hset(sock, "h1", {{"a", "1"}});
+    cacheX_unlink(sock, {"h1", "p1"});
+
+    const std::pair<const char *, const char *> expected[] = {
+        {"h1", "hset"},    {"h1", "hdel"}, {"h1", "hdel"}, {"h1", "del"}, {"p1", "pfadd"},
+        {"p1", "pfmerge"}, {"h1", "hset"}, {"h1", "del"},  {"p1", "del"},
+    };
+    CacheXMessage msg;
+    for (const auto &event : expected) {
+        if (cacheX_next_message(sub, msg, 1000) != 1 ||
+            msg.channel != std::string("__keyspace__:") + event.first ||
+            msg.payload != event.second) {
+            return fail("keyspace event of a hash or HyperLogLog");
+        }
+    }
+    if (cacheX_next_message(sub, msg, 100) != 0) {
+        return fail("keyspace event for a write that changed nothing");
+    }
+    cacheX_subscriber_close(sub);
+    return 0;
+}
+
+// A subscriber that stops reading is disconnected once it is PUBSUB_LIMIT behind
+static int slow_subscriber(int sock) {
+    CacheXSubscriber *slow = subscriber({"bulk"});
+    if (!slow) {
+        return fail("SUBSCRIBE");
+    }
+    std::string payload(64 * 1024, 'x');
+    for (int i = 0; i < 400; i++) {
+        cacheX_publish(sock, "bulk", payload);
+    }
+    if (info(sock)["pubsub_disconnects"] != 1) {
+        return fail("slow subscriber kept");
+    }
+    CacheXMessage msg;
+    int rv;
+    while ((rv = cacheX_next_message(slow, msg, 1000)) == 1) {
+    }
+    cacheX_subscriber_close(slow);
+    if (rv != -1 || info(sock)["pubsub_channels"] != 0) {
+        return fail("slow subscriber closed");
+    }
+    return 0;
+}
+
+static int run() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+    int rv = fan_out(sock);
+    rv = rv ? rv : keyspace(sock);
+    rv = rv ? rv : keyspace_types(sock);
+    rv = rv ? rv : slow_subscriber(sock);
+    cacheX_close(sock);
+    return rv;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.keyspace_events = true;
+    opts.pubsub_limit = PUBSUB_LIMIT;
+    pid_t pid = spawn_server(opts);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] pub/sub\n");
+    }
+    return rv;
+}
@@ -0,0 +1,52 @@
+#ifndef SERVER_FIXTURE_HPP_
+#define SERVER_FIXTURE_HPP_
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cacheX_client.hpp"
+#include "server.hpp"
+
+// Run start_server() in a forked child with its output silenced and wait until it accepts
+// connections on opts.port.
+static inline pid_t spawn_server(const ServerOptions &opts) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        start_server(opts);
+        _exit(0);
+    }
+
+    for (int i = 0; i < 200; i++) {
+        int sock = cacheX_connect("127.0.0.1", opts.port);
+        if (sock >= 0) {
+            cacheX_close(sock);
+            return pid;
+        }
+        usleep(10 * 1000);
+    }
+    return pid;
+}
+
+static inline pid_t spawn_server(int port) {
+    ServerOptions opts;
+    opts.port = port;
+    return spawn_server(opts);
+}
+
+static inline void stop_server(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+static inline int fail(const char *what) {
+    fprintf(stderr, "[FAIL] %s\n", what);
+    return 1;
+}
+
+#endif  // SERVER_FIXTURE_HPP_
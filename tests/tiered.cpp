@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cacheX_async.hpp"
+#include "cacheX_client.hpp"
+#include "cacheX_protocol.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17371
+#define NUM_KEYS 2000
+#define SPILL_MEM (64 * 1024)
+
+static std::string value_for(int i, int gen) {
+    return std::string(500, 'a' + (i + gen) % 26) + std::to_string(i) + "/" + std::to_string(gen);
+}
+
+static std::map<std::string, uint64_t> info(int sock) {
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::map<std::string, uint64_t> out;
+    cacheX_info(sock, fields);
+    for (const auto &field : fields) {
+        out[field.first] = strtoull(field.second.c_str(), nullptr, 10);
+    }
+    return out;
+}
+
+// Pipelines a GET for every key over several connections, so many requests queue up behind
+// the ones waiting for the disk
+static int check_all(int gen_of_3_in_4, int gen_of_rest) {
+    CacheXAsync *client = cacheX_async_connect("127.0.0.1", TEST_PORT, 4);
+    if (!client) {
+        return fail("cacheX_async_connect");
+    }
+    int ok = 0;
+    for (int i = 0; i < NUM_KEYS; i++) {
+        std::string expected = value_for(i, i % 4 ? gen_of_3_in_4 : gen_of_rest);
+        cacheX_async_get(client, "key_" + std::to_string(i),
+                         [&ok, expected](int status, const std::string &value) {
+                             ok += status == RES_OK && value == expected;
+                         });
+    }
+    cacheX_async_wait(client);
+    cacheX_async_close(client);
+    return ok == NUM_KEYS ? 0 : fail("values read back from the spill log");
+}
+
+static int run() {
+    CacheXAsync *client = cacheX_async_connect("127.0.0.1", TEST_PORT, 4);
+    if (!client) {
+        return fail("cacheX_async_connect");
+    }
+    for (int i = 0; i < NUM_KEYS; i++) {
+        cacheX_async_set_quiet(client, "key_" + std::to_string(i), value_for(i, 0));
+    }
+    cacheX_async_set(client, "small", "v", [](int, const std::string &) {});
+    cacheX_async_wait(client);
+    cacheX_async_close(client);
+
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    auto stats = info(sock);
+    if (stats["keys"] != NUM_KEYS + 1) {
+        return fail("the wait returned before every quiet SET ran");
+    }
+    if (stats["spill_keys"] < NUM_KEYS / 2 || stats["spill_resident_bytes"] > SPILL_MEM) {
+        return fail("values over the budget were not spilled");
+    }
+
+    // The oldest keys are on disk; every command that needs their value waits for it
+    std::string value, old;
+    uint64_t version = 0;
+    if (cacheX_get_versioned(sock, "key_0", value, version) != 0 || value != value_for(0, 0)) {
+        return fail("GET WITHVER of a spilled value");
+    }
+    if (cacheX_getset(sock, "key_1", value_for(1, 0), old) != 0 || old != value_for(1, 0)) {
+        return fail("GETSET of a spilled value");
+    }
+    if (cacheX_get(sock, "small") != "v") {
+        return fail("small value");
+    }
+    if (check_all(0, 0) != 0) {
+        return 1;
+    }
+    if (info(sock)["spill_reads"] == 0) {
+        return fail("spill_reads");
+    }
+
+    // Overwriting 3 keys in 4 leaves the old segments mostly dead, so they get compacted
+    for (int i = 0; i < NUM_KEYS; i++) {
+        if (i % 4) {
+            cacheX_set(sock, "key_" + std::to_string(i), value_for(i, 1));
+        }
+    }
+    bool compacted = false;
+    for (int i = 0; i < 100 && !compacted; i++) {
+        stats = info(sock);
+        compacted = stats["spill_compactions"] > 0;
+        usleep(50 * 1000);
+    }
+    if (!compacted || stats["spill_live_bytes"] > stats["spill_disk_bytes"]) {
+        return fail("compaction");
+    }
+    if (check_all(1, 0) != 0) {
+        return 1;
+    }
+
+    Response response;
+    send_request(sock, {"DEL", "key_0"});
+    read_response(sock, response);
+    if (cacheX_get(sock, "key_0") != "" || info(sock)["keys"] != NUM_KEYS) {
+        return fail("DEL of a spilled value");
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    ServerOptions opts;
+    opts.port = TEST_PORT;
+    opts.spill_dir = "/tmp";
+    opts.spill_mem = SPILL_MEM;
+    opts.spill_segment = 256 * 1024;
+    pid_t pid = spawn_server(opts);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] tiered storage\n");
+    }
+    return rv;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "topk.hpp"
+
+static int fail(const char *what, uint64_t got, uint64_t want) {
+    fprintf(stderr, "[FAIL] %s: got %lu, want %lu\n", what, (unsigned long)got,
+            (unsigned long)want);
+    return 1;
+}
+
+static uint64_t hash_of(const std::string &key) {
+    return sketch_hash(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+}
+
+static void add(TopK &topk, const std::string &key) {
+    topk.add(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+}
+
+static int test_sketch() {
+    CountMinSketch sketch;
+    uint64_t hot = hash_of("hot");
+    uint32_t count = 0;
+    for (int i = 0; i < 1000; i++) {
+        count = sketch.add(hot);
+    }
+    if (count != 1000) {
+        return fail("estimate of a lone key", count, 1000);
+    }
+    // Many distinct keys share cells with each other, but never push an estimate below the
+    // true count, and conservative update keeps the over-estimate of a cold key small
+    for (int i = 0; i < 20000; i++) {
+        sketch.add(hash_of("cold:" + std::to_string(i)));
+    }
+    uint32_t hot_now = sketch.add(hot) - 1;
+    if (hot_now < 1000) {
+        return fail("hot key under-estimated", hot_now, 1000);
+    }
+    uint64_t over = 0;
+    for (int i = 0; i < 1000; i++) {
+        over += sketch.add(hash_of("cold:" + std::to_string(i))) - 2;
+    }
+    if (over / 1000 > 10) {
+        return fail("mean over-estimate of a cold key", over / 1000, 10);
+    }
+    sketch.decay(32768);  // halve
+    uint32_t halved = sketch.add(hot) - 1;
+    if (halved != (hot_now + 1) / 2) {
+        return fail("halved estimate", halved, (hot_now + 1) / 2);
+    }
+    return 0;
+}
+
+// A skewed stream: a few hot keys among many keys seen once
+static int test_heavy_hitters() {
+    TopK topk;
+    for (int i = 0; i < 50000; i++) {
+        add(topk, "cold:" + std::to_string(i));
+        if (i % 10 == 0) {
+            add(topk, "hot:" + std::to_string(i % 50 / 10));  // hot:0 .. hot:4, 1000 each
+        }
+        if (i % 25 == 0) {
+            add(topk, "warm");  // 2000
+        }
+    }
+    if (topk.heap.size() > kTopK) {
+        return fail("heap size", topk.heap.size(), kTopK);
+    }
+    auto top = topk.top(6);
+    if (top.size() != 6 || top[0].first != "warm" || top[0].second < 2000) {
+        return fail("hottest key", top.empty() ? 0 : top[0].second, 2000);
+    }
+    std::set<std::string> hot;
+    for (size_t i = 1; i < top.size(); i++) {
+        hot.insert(top[i].first);
+        if (top[i].second < 1000 || top[i].second > top[i - 1].second) {
+            return fail("hot key count or order", top[i].second, 1000);
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        if (!hot.count("hot:" + std::to_string(i))) {
+            return fail("hot key missing from the top", i, 0);
+        }
+    }
+
+    topk.decay(32768);
+    auto halved = topk.top(1);
+    if (halved[0].first != "warm" || halved[0].second != top[0].second / 2) {
+        return fail("decayed count", halved[0].second, top[0].second / 2);
+    }
+    return 0;
+}
+
+static int test_long_key() {
+    TopK topk;
+    std::string key(kMaxTrackedKeyLen * 2, 'k');
+    add(topk, key);
+    auto top = topk.top(10);
+    if (top.size() != 1 || top[0].first != key.substr(0, kMaxTrackedKeyLen)) {
+        return fail("truncated key length", top.empty() ? 0 : top[0].first.size(),
+                    kMaxTrackedKeyLen);
+    }
+    return 0;
+}
+
+int main() {
+    if (test_sketch() || test_heavy_hitters() || test_long_key()) {
+        return 1;
+    }
+    printf("[PASS] top-k\n");
+    return 0;
+}
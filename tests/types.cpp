@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cacheX_client.hpp"
+#include "server_fixture.hpp"
+
+#define TEST_PORT 17441
+
+// Round trips of the commands on the non-string types through a server
+
+static std::vector<std::string> range(const std::string &prefix, int from, int to) {
+    std::vector<std::string> out;
+    for (int i = from; i < to; i++) {
+        out.push_back(prefix + std::to_string(i));
+    }
+    return out;
+}
+
+// Standard error for 16384 registers is 0.81%; allow a bit over three sigma
+static bool close_enough(int64_t got, int64_t want) {
+    return llabs(got - want) <= want * 0.025 + 1;
+}
+
+static int test_pfmerge(int sock) {
+    // One dense and one sparse sketch, overlapping in 500 elements
+    cacheX_pfadd(sock, "hll_a", range("e", 0, 5000));
+    cacheX_pfadd(sock, "hll_b", range("e", 4500, 4600));
+    cacheX_pfadd(sock, "hll_b", range("f", 0, 400));
+    if (cacheX_pfmerge(sock, "hll_ab", {"hll_a", "hll_b", "hll_missing"}) != 0) {
+        return fail("PFMERGE into a new key");
+    }
+    int64_t merged = cacheX_pfcount(sock, {"hll_ab"});
+    if (!close_enough(merged, 5400) || merged != cacheX_pfcount(sock, {"hll_a", "hll_b"})) {
+        return fail("PFMERGE estimate");
+    }
+    // dest keeps its own elements
+    cacheX_pfadd(sock, "hll_dest", range("g", 0, 100));
+    if (cacheX_pfmerge(sock, "hll_dest", {"hll_b"}) != 0 ||
+        !close_enough(cacheX_pfcount(sock, {"hll_dest"}), 600)) {
+        return fail("PFMERGE into an existing sketch");
+    }
+    if (cacheX_pfcount(sock, {"hll_b"}) != cacheX_pfcount(sock, {"hll_b", "hll_missing"})) {
+        return fail("PFMERGE changed a source");
+    }
+    cacheX_set(sock, "plain", "string");
+    if (cacheX_pfmerge(sock, "plain", {"hll_a"}) != -1 ||
+        cacheX_pfmerge(sock, "hll_x", {"hll_a", "plain"}) != -1) {
+        return fail("PFMERGE with a string key");
+    }
+    if (cacheX_get(sock, "plain") != "string") {
+        return fail("failed PFMERGE changed its destination");
+    }
+    return 0;
+}
+
+// HGETALL in both encodings: packed (small) and table form (past 128 fields)
+static int test_hgetall(int sock) {
+    std::vector<std::pair<std::string, std::string>> want, got;
+    for (int i = 0; i < 200; i++) {
+        want.emplace_back("f" + std::to_string(i), i == 7 ? "" : "v" + std::to_string(i));
+        cacheX_hset(sock, "hash", {want.back()});
+        if (i == 9 || i == 199) {
+            if (cacheX_hgetall(sock, "hash", got) != 0) {
+                return fail("HGETALL");
+            }
+            std::sort(got.begin(), got.end());
+            std::vector<std::pair<std::string, std::string>> sorted = want;
+            std::sort(sorted.begin(), sorted.end());
+            if (got != sorted) {
+                return fail(i == 9 ? "HGETALL of a packed hash" : "HGETALL of a large hash");
+            }
+        }
+    }
+    if (cacheX_hgetall(sock, "hash_missing", got) != 0 || !got.empty()) {
+        return fail("HGETALL of a missing key");
+    }
+    cacheX_set(sock, "plain", "string");
+    if (cacheX_hgetall(sock, "plain", got) != -1) {
+        return fail("HGETALL of a string");
+    }
+    return 0;
+}
+
+// HMGET replies with a nil element for each missing field, unlike an empty value
+static int test_hmget(int sock) {
+    cacheX_hset(sock, "user", {{"name", "ada"}, {"empty", ""}, {"lang", "c++"}});
+    std::vector<std::string> fields = {"name", "nope", "empty", "lang", "nope2"};
+    std::vector<std::string> values;
+    std::vector<bool> found;
+    if (cacheX_hmget(sock, "user", fields, values, found) < 0 || values.size() != 5 ||
+        found != std::vector<bool>{true, false, true, true, false} || values[0] != "ada" ||
+        values[2] != "" || values[3] != "c++") {
+        return fail("HMGET with missing fields");
+    }
+    if (cacheX_hmget(sock, "user_missing", {"a", "b"}, values, found) < 0 ||
+        found != std::vector<bool>{false, false}) {
+        return fail("HMGET of a missing key");
+    }
+    if (cacheX_hmget(sock, "plain", {"a"}, values, found) != -1) {
+        return fail("HMGET of a string");
+    }
+    return 0;
+}
+
+static int run() {
+    int sock = cacheX_connect("127.0.0.1", TEST_PORT);
+    if (sock < 0) {
+        return fail("connect");
+    }
+    if (test_pfmerge(sock) != 0 || test_hgetall(sock) != 0 || test_hmget(sock) != 0) {
+        return 1;
+    }
+    cacheX_close(sock);
+    return 0;
+}
+
+int main() {
+    pid_t pid = spawn_server(TEST_PORT);
+    int rv = run();
+    stop_server(pid);
+    if (rv == 0) {
+        printf("[PASS] data types\n");
+    }
+    return rv;
+}
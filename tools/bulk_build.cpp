@@ -0,0 +1,65 @@
+// Build a BULKLOAD file from tab-separated text, one "key<TAB>value" line per key. Later lines
+// win over earlier ones with the same key.
+//
+//   cacheX_bulk_build keys.tsv /var/tmp/keys.cxb     (- reads standard input)
+//   cacheX_cli, then: BULKLOAD /var/tmp/keys.cxb     (the path is opened by the server)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "bulk_file.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input.tsv | -> <output>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    BulkWriter writer;
+    if (!bulk_writer_open(writer, argv[2])) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    char *line = nullptr;
+    size_t cap = 0;
+    ssize_t len = 0;
+    uint64_t lineno = 0, nkeys = 0;
+    while ((len = getline(&line, &cap, in)) >= 0) {
+        lineno++;
+        if (len > 0 && line[len - 1] == '\n') {
+            len--;
+        }
+        if (len == 0) {
+            continue;
+        }
+        const char *tab = static_cast<const char *>(memchr(line, '\t', len));
+        if (!tab) {
+            fprintf(stderr, "%s:%llu: no tab between key and value\n", argv[1],
+                    (unsigned long long)lineno);
+            return EXIT_FAILURE;
+        }
+        std::string key(line, tab - line);
+        const uint8_t *value = reinterpret_cast<const uint8_t *>(tab + 1);
+        if (!bulk_writer_put(writer, REC_STR, key, value, line + len - (tab + 1))) {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        nkeys++;
+    }
+    free(line);
+    if (!bulk_writer_close(writer)) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+    printf("Wrote %llu keys in %zu chunks to %s\n", (unsigned long long)nkeys,
+           writer.chunks.size(), argv[2]);
+    return EXIT_SUCCESS;
+}